@@ -99,6 +99,11 @@ complete -c j4-dmenu-desktop -Fr      -l usage-log          -d "Set usage log"
 complete -c j4-dmenu-desktop          -l prune-bad-usage-log-entries -d "Remove bad history entries"
 complete -c j4-dmenu-desktop     -s x -l use-xdg-de         -d "Enables reading \$XDG_CURRENT_DESKTOP to determine the desktop environment"
 complete -c j4-dmenu-desktop -Fr      -l wait-on            -d "Enable daemon mode"
+complete -c j4-dmenu-desktop -x       -l wait-on-delay      -d "Wait for more changes of desktop files in daemon mode"
+complete -c j4-dmenu-desktop          -l wait-on-close-write -d "Reload desktop files in daemon mode only after they have been closed"
+complete -c j4-dmenu-desktop          -l use-cache          -d "Cache parsed desktop files"
+complete -c j4-dmenu-desktop          -l optimistic-menu    -d "Show the menu from the previous run before reading desktop files"
+complete -c j4-dmenu-desktop          -l lazy-exec          -d "Parse Exec and Path keys only for the selected desktop file"
 complete -c j4-dmenu-desktop -Fr      -l wrapper            -d "A wrapper binary"
 complete -c j4-dmenu-desktop     -s I -l i3-ipc             -d "Execute desktop entries through i3 IPC"
 complete -c j4-dmenu-desktop          -l skip-i3-exec-check -d "Disable the check for '--wrapper \"i3 exec\"'"
@@ -0,0 +1,283 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "AppCache.hh"
+
+#include <spdlog/spdlog.h>
+
+#include <errno.h>
+#include <string.h>
+#include <string_view>
+#include <utility>
+
+// Helpers for (de)serialization of the cache file. All integers are stored in
+// native byte order, strings are prefixed by their length.
+namespace AppCacheFormat
+{
+template <typename T> static void put(std::string &buf, T value) {
+    buf.append(reinterpret_cast<const char *>(&value), sizeof value);
+}
+
+static void put_string(std::string &buf, std::string_view str) {
+    put<uint32_t>(buf, str.size());
+    buf += str;
+}
+
+class Reader
+{
+public:
+    Reader(const std::string &buf) : buf(buf) {}
+
+    template <typename T> bool get(T &value) {
+        if (this->buf.size() - this->pos < sizeof value)
+            return false;
+        memcpy(&value, this->buf.data() + this->pos, sizeof value);
+        this->pos += sizeof value;
+        return true;
+    }
+
+    bool get_string(std::string &str) {
+        uint32_t len;
+        if (!get(len) || this->buf.size() - this->pos < len)
+            return false;
+        str.assign(this->buf, this->pos, len);
+        this->pos += len;
+        return true;
+    }
+
+    bool at_end() const {
+        return this->pos == this->buf.size();
+    }
+
+private:
+    const std::string &buf;
+    std::string::size_type pos = 0;
+};
+}; // namespace AppCacheFormat
+
+using namespace AppCacheFormat;
+
+AppCache::FileIdentity::FileIdentity(const struct stat &st)
+    : dev(st.st_dev), ino(st.st_ino), mtime_sec(st.st_mtim.tv_sec),
+      mtime_nsec(st.st_mtim.tv_nsec), size(st.st_size) {}
+
+bool AppCache::FileIdentity::operator==(const FileIdentity &other) const {
+    return dev == other.dev && ino == other.ino &&
+           mtime_sec == other.mtime_sec && mtime_nsec == other.mtime_nsec &&
+           size == other.size;
+}
+
+AppCache::Entry::Entry(const FileIdentity &identity, int rank, State state,
+                       std::optional<Application> app, std::string reason)
+    : identity(identity), rank(rank), state(state), app(std::move(app)),
+      reason(std::move(reason)) {}
+
+AppCache::CachedFile::CachedFile(Entry entry, bool used)
+    : entry(std::move(entry)), used(used) {}
+
+AppCache::AppCache(std::string path, std::string key)
+    : path(std::move(path)), key(std::move(key)) {
+    load();
+}
+
+void AppCache::load() {
+    std::string buf;
+    if (!read_file(this->path, buf)) {
+        if (errno == ENOENT)
+            SPDLOG_INFO("AppCache: Cache file '{}' doesn't exist yet.",
+                        this->path);
+        else
+            SPDLOG_WARN("Couldn't read cache file '{}': {}", this->path,
+                        strerror(errno));
+        // The cache file will be (re)created by save().
+        this->dirty = true;
+        return;
+    }
+
+    if (buf.compare(0, J4DDCACHE_HEADER_LENGTH, J4DDCACHE_HEADER) != 0) {
+        SPDLOG_WARN("Cache file '{}' has unknown format, ignoring it...",
+                    this->path);
+        this->dirty = true;
+        return;
+    }
+    buf.erase(0, J4DDCACHE_HEADER_LENGTH);
+
+    Reader reader(buf);
+    auto malformed = [this]() {
+        SPDLOG_WARN("Cache file '{}' is malformed, ignoring it...",
+                    this->path);
+        this->files.clear();
+        this->dirty = true;
+    };
+
+    std::string stored_key;
+    if (!reader.get_string(stored_key))
+        return malformed();
+    if (stored_key != this->key) {
+        SPDLOG_INFO("AppCache: Cache file '{}' has been created with different "
+                    "locale, desktop environments or search path, ignoring "
+                    "it...",
+                    this->path);
+        this->dirty = true;
+        return;
+    }
+
+    uint32_t count;
+    if (!reader.get(count))
+        return malformed();
+    this->files.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        std::string filename;
+        FileIdentity identity;
+        int32_t rank;
+        unsigned char state;
+        if (!reader.get_string(filename) || !reader.get(identity.dev) ||
+            !reader.get(identity.ino) || !reader.get(identity.mtime_sec) ||
+            !reader.get(identity.mtime_nsec) || !reader.get(identity.size) ||
+            !reader.get(rank) || !reader.get(state))
+            return malformed();
+
+        std::optional<Application> app;
+        std::string reason;
+        switch ((State)state) {
+        case State::parsed: {
+            std::string name, generic_name, exec, app_path;
+            unsigned char terminal;
+            if (!reader.get_string(name) || !reader.get_string(generic_name) ||
+                !reader.get_string(exec) || !reader.get_string(app_path) ||
+                !reader.get(terminal))
+                return malformed();
+            app.emplace(std::move(name), std::move(generic_name),
+                        std::move(exec), std::move(app_path), filename,
+                        terminal != 0);
+            break;
+        }
+        case State::disabled:
+        case State::invalid:
+            if (!reader.get_string(reason))
+                return malformed();
+            break;
+        default:
+            return malformed();
+        }
+
+        this->files.try_emplace(std::move(filename),
+                                Entry(identity, rank, (State)state,
+                                      std::move(app), std::move(reason)),
+                                false);
+    }
+    if (!reader.at_end())
+        return malformed();
+
+    SPDLOG_DEBUG("AppCache: Loaded {} entries from '{}'.", this->files.size(),
+                 this->path);
+}
+
+const AppCache::Entry *AppCache::lookup(const std::string &filename,
+                                        const struct stat &st, int rank) {
+    std::lock_guard lock(this->mutex);
+    auto iter = this->files.find(filename);
+    if (iter == this->files.end())
+        return nullptr;
+    CachedFile &cached = iter->second;
+    if (cached.entry.rank != rank || !(cached.entry.identity == st)) {
+        SPDLOG_DEBUG("AppCache: Cached entry of '{}' is outdated.", filename);
+        return nullptr;
+    }
+    cached.used = true;
+    return &cached.entry;
+}
+
+bool AppCache::contains(const std::string &filename) const {
+    std::lock_guard lock(this->mutex);
+    return this->files.find(filename) != this->files.end();
+}
+
+void AppCache::store(const std::string &filename, Entry entry) {
+    std::lock_guard lock(this->mutex);
+    this->files.insert_or_assign(filename, CachedFile(std::move(entry), true));
+    this->dirty = true;
+}
+
+void AppCache::save() {
+    bool has_unused = false;
+    for (const auto &[filename, cached] : this->files) {
+        if (!cached.used) {
+            has_unused = true;
+            break;
+        }
+    }
+    if (!this->dirty && !has_unused) {
+        SPDLOG_DEBUG("AppCache: Cache is up to date, not saving.");
+        return;
+    }
+
+    std::string buf = J4DDCACHE_HEADER;
+    put_string(buf, this->key);
+    uint32_t count = 0;
+    for (const auto &[filename, cached] : this->files)
+        count += cached.used;
+    put(buf, count);
+    for (const auto &[filename, cached] : this->files) {
+        if (!cached.used)
+            continue;
+        const Entry &entry = cached.entry;
+        put_string(buf, filename);
+        put(buf, entry.identity.dev);
+        put(buf, entry.identity.ino);
+        put(buf, entry.identity.mtime_sec);
+        put(buf, entry.identity.mtime_nsec);
+        put(buf, entry.identity.size);
+        put<int32_t>(buf, entry.rank);
+        put<unsigned char>(buf, (unsigned char)entry.state);
+        if (entry.state == State::parsed) {
+            put_string(buf, entry.app->name);
+            put_string(buf, entry.app->generic_name);
+            put_string(buf, entry.app->exec);
+            put_string(buf, entry.app->path);
+            put<unsigned char>(buf, entry.app->terminal);
+        } else
+            put_string(buf, entry.reason);
+    }
+
+    if (!write_file_atomically(this->path, buf)) {
+        SPDLOG_WARN("Couldn't write cache file '{}': {}", this->path,
+                    strerror(errno));
+        return;
+    }
+    this->dirty = false;
+    SPDLOG_DEBUG("AppCache: Saved {} entries to '{}'.", count, this->path);
+}
+
+std::string AppCache::make_key(const LocaleSuffixes &suffixes,
+                               const stringlist_t &desktopenvs,
+                               const stringlist_t &search_path) {
+    // Separators are appended after each element, so that e.g. empty
+    // desktopenvs and a single empty desktop environment differ.
+    std::string result = suffixes.serialize();
+    result += '\n';
+    for (const std::string &env : desktopenvs) {
+        result += env;
+        result += ':';
+    }
+    result += '\n';
+    for (const std::string &path : search_path) {
+        result += path;
+        result += ':';
+    }
+    return result;
+}
@@ -0,0 +1,131 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef APPCACHE_DEF
+#define APPCACHE_DEF
+
+#include <mutex>
+#include <optional>
+#include <stdint.h>
+#include <string>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unordered_map>
+
+#include "Application.hh"
+#include "LocaleSuffixes.hh"
+#include "Utilities.hh"
+
+#define J4DDCACHE_HEADER "j4dd app cache v1\n"
+#define J4DDCACHE_HEADER_LENGTH 18
+
+// AppCache is an on-disk cache of parsed desktop files. It is used by
+// AppManager's ctor to skip parsing of desktop files which haven't changed
+// since the last invocation of j4-dmenu-desktop.
+//
+// Each cached desktop file is validated by its device, inode, modification time
+// and size. The whole cache is discarded when the key passed to the ctor
+// doesn't match the key stored in the cache file. The key must describe
+// everything that influences the result of Application's ctor (see
+// AppCache::make_key()).
+//
+// The cache file is stored in native byte order. It isn't meant to be portable.
+class AppCache
+{
+public:
+    // These are the possible outcomes of Application's ctor that can be
+    // cached. Failure to open a desktop file isn't cached.
+    enum class State : unsigned char { parsed, disabled, invalid };
+
+    // This is the part of struct stat which is used to determine whether a
+    // cached entry is up to date.
+    struct FileIdentity
+    {
+        uint64_t dev;
+        uint64_t ino;
+        int64_t mtime_sec;
+        int64_t mtime_nsec;
+        int64_t size;
+
+        FileIdentity() = default;
+        FileIdentity(const struct stat &st);
+
+        bool operator==(const FileIdentity &other) const;
+    };
+
+    struct Entry
+    {
+        FileIdentity identity;
+        int rank;
+        State state;
+        // This is populated only when state == State::parsed.
+        std::optional<Application> app;
+        // This is the reason why the desktop file is disabled or invalid.
+        std::string reason;
+
+        Entry(const FileIdentity &identity, int rank, State state,
+              std::optional<Application> app, std::string reason);
+    };
+
+    // The cache file is read in the ctor (if it exists). Errors are logged,
+    // but they aren't fatal. A broken cache is treated like an empty one.
+    AppCache(std::string path, std::string key);
+
+    AppCache(const AppCache &) = delete;
+    void operator=(const AppCache &) = delete;
+
+    // lookup(), store() and contains() may be called from multiple threads at
+    // once, but each filename may be stored only by a single thread.
+
+    // Return the cached entry of filename if it is up to date. Return nullptr
+    // otherwise.
+    const Entry *lookup(const std::string &filename, const struct stat &st,
+                        int rank);
+    void store(const std::string &filename, Entry entry);
+    // Return true if there is an entry of filename (even an outdated one).
+    bool contains(const std::string &filename) const;
+
+    // Write the cache to disk if it has changed. Only entries which have been
+    // looked up or stored since the ctor are written; entries of desktop files
+    // which no longer exist are dropped this way.
+    void save();
+
+    static std::string make_key(const LocaleSuffixes &suffixes,
+                                const stringlist_t &desktopenvs,
+                                const stringlist_t &search_path);
+
+private:
+    struct CachedFile
+    {
+        Entry entry;
+        bool used;
+
+        CachedFile(Entry entry, bool used);
+    };
+
+    void load();
+
+    std::string path;
+    std::string key;
+    std::unordered_map<std::string /* filename */, CachedFile> files;
+    bool dirty = false;
+    mutable std::mutex mutex;
+};
+
+static_assert(!std::is_copy_constructible_v<AppCache>);
+
+#endif
@@ -20,8 +20,13 @@
 #include <spdlog/spdlog.h>
 
 #include <algorithm>
+#include <errno.h>
+#include <limits>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <system_error>
+#include <tuple>
 
 #include "CMDLineAssembler.hh"
 
@@ -47,9 +52,23 @@ std::string get_desktop_id(const std::string &filename, std::string_view base) {
 Desktop_file_rank::Desktop_file_rank(string b, std::vector<string> f)
     : base_path(std::move(b)), files(std::move(f)) {}
 
-Resolved_application::Resolved_application(const Application *app,
+bool Application_handle::operator==(const Application_handle &other) const {
+    return this->slot == other.slot && this->generation == other.generation;
+}
+
+bool Application_handle::operator!=(const Application_handle &other) const {
+    return !(*this == other);
+}
+
+Resolved_application::Resolved_application(Application_handle handle,
                                            bool is_generic)
-    : app(app), is_generic(is_generic) {}
+    : handle(handle), is_generic(is_generic) {}
+
+AppManager::Name_change::Name_change(
+    Type type, string name, std::optional<Resolved_application> previous,
+    std::optional<Resolved_application> current)
+    : type(type), name(std::move(name)), previous(previous), current(current) {
+}
 
 #ifdef DEBUG
 bool validate_desktop_file_list(const Desktop_file_list &files) {
@@ -72,8 +91,11 @@ bool validate_desktop_file_list(const Desktop_file_list &files) {
 #endif
 
 AppManager::AppManager(Desktop_file_list files, stringlist_t desktopenvs,
-                       LocaleSuffixes suffixes, bool wine_compatibility_mode)
-    : suffixes(std::move(suffixes)), desktopenvs(desktopenvs) {
+                       LocaleSuffixes suffixes, bool wine_compatibility_mode,
+                       AppCache *cache, DesktopFileLoader *loader,
+                       ThreadPool *pool, bool lazy_exec)
+    : suffixes(std::move(suffixes)), desktopenvs(desktopenvs),
+      wine_compatibility_mode(wine_compatibility_mode), lazy_exec(lazy_exec) {
     SPDLOG_DEBUG("AppManager: Entered AppManager");
 #ifdef DEBUG
     if (!validate_desktop_file_list(files)) {
@@ -85,90 +107,441 @@ AppManager::AppManager(Desktop_file_list files, stringlist_t desktopenvs,
         SPDLOG_ERROR("Rank overflow in AppManager ctor!");
         exit(EXIT_FAILURE);
     }
-    for (int rank = 0; rank < (int)files.size(); ++rank) {
-        auto &rank_files = files[rank].files;
-        auto &rank_base_path = files[rank].base_path;
-
-        SPDLOG_DEBUG("AppManager: Processing rank -> {} <- (base: {})", rank,
-                     rank_base_path);
-
-        for (const string &filename : rank_files) {
-            string desktop_file_ID = get_desktop_id(filename, rank_base_path);
-
-            SPDLOG_DEBUG("AppManager:   Handling file '{}' ID: {}", filename,
-                         desktop_file_ID);
-
-            try {
-                auto try_add = this->applications.try_emplace(
-                    desktop_file_ID, rank, in_place_t{}, filename.c_str(),
-                    this->liner, this->suffixes, this->desktopenvs);
-
-                // Handle desktop file ID collision.
-                if (!try_add.second) {
-                    SPDLOG_DEBUG(
-                        "AppManager:     Collision detected, skipping!");
-                    continue;
-                }
-
-                Managed_application &newly_added = try_add.first->second;
-
-                // Skip desktop file if its Exec key is malformed.
-                auto validate_exec_key =
-                    CMDLineAssembly::validate_exec_key(newly_added.app->exec);
-                if (wine_compatibility_mode) {
-                    if (validate_exec_key)
-                        SPDLOG_DEBUG("AppManager:     Desktop file's Exec is "
-                                     "malformed, but desktop file is protected "
-                                     "by Wine compatibility mode: {}",
-                                     *validate_exec_key);
-                } else {
-                    if (validate_exec_key) {
-                        SPDLOG_WARN("Desktop file '{}' is using invalid escape "
-                                    "sequence in it's Exec key, skipping: {}",
-                                    filename, *validate_exec_key);
-                        // Remove the app.
-                        this->applications.erase(try_add.first);
-                        continue;
-                    }
-                }
-
-                // Add the names.
-                auto add_result = this->name_app_mapping.try_emplace(
-                    newly_added.app->name, &*newly_added.app, false);
-                if (!add_result.second)
-                    SPDLOG_DEBUG(
-                        "AppManager:     Name '{}' is already taken! Not "
-                        "registering.",
-                        newly_added.app->name);
-                if (!newly_added.app->generic_name.empty()) {
-                    auto add_result2 = this->name_app_mapping.try_emplace(
-                        newly_added.app->generic_name, &*newly_added.app, true);
-                    if (!add_result2.second)
-                        SPDLOG_DEBUG(
-                            "AppManager:     GenericName '{}' is already "
-                            "taken! Not registering.",
-                            newly_added.app->generic_name);
-                }
-            } catch (const disabled_error &e) {
-                SPDLOG_DEBUG("AppManager:     Desktop file is disabled: {}",
-                             e.what());
-                // Add an empty Application that only occupies desktop ID + rank
-                auto try_add =
-                    this->applications.try_emplace(desktop_file_ID, rank);
-                if (!try_add.second)
-                    SPDLOG_DEBUG(
-                        "AppManager:     Collision detected, skipping!");
-                continue;
-            } catch (const std::system_error &e) {
-                SPDLOG_WARN("Couldn't open file '{}': {}", filename, e.what());
-                continue;
-            } catch (const invalid_error &e) {
-                SPDLOG_WARN("Desktop file '{}' is invalid: {}", filename,
-                            e.what());
-                continue;
+
+    // Desktop files are processed in two phases. First, desktop files are
+    // parsed (possibly in parallel). Then they are added to the table and
+    // name_app_mapping in rank and file order, so the result doesn't depend
+    // on the order in which they have been parsed.
+    struct Parse_job
+    {
+        const string *filename;
+        int rank;
+        string ID;
+        // Only the first desktop file with a given desktop file ID is parsed
+        // in the first phase. Others are most likely hidden by it. If they
+        // aren't (the first one can't be opened or it's invalid), they are
+        // parsed during the merge.
+        bool prefetch;
+        LoadedFile *loaded = nullptr;
+        std::optional<Application::ParseResult> result;
+        uint64_t content_hash = Application_table::no_content_hash;
+
+        Parse_job(const string *filename, int rank, string ID, bool prefetch)
+            : filename(filename), rank(rank), ID(std::move(ID)),
+              prefetch(prefetch) {}
+    };
+
+    std::vector<Parse_job> jobs;
+    {
+        FlatHashSet<string> seen_IDs;
+        for (int rank = 0; rank < (int)files.size(); ++rank) {
+            for (const string &filename : files[rank].files) {
+                string ID = get_desktop_id(filename, files[rank].base_path);
+                bool prefetch = seen_IDs.insert(ID).second;
+                jobs.emplace_back(&filename, rank, std::move(ID), prefetch);
             }
         }
     }
+
+    // Read all desktop files which will be parsed at once. Files present in
+    // cache are skipped, they will be most likely retrieved from it. If they
+    // are outdated, they are read by Application's ctor as usual.
+    std::vector<LoadedFile> loaded;
+    if (loader) {
+        std::vector<const char *> to_load;
+        for (const Parse_job &job : jobs) {
+            if (job.prefetch && !(cache && cache->contains(*job.filename)))
+                to_load.push_back(job.filename->c_str());
+        }
+        loaded = loader->load(to_load);
+        SPDLOG_DEBUG("AppManager: Read {} desktop files using {} loader.",
+                     to_load.size(), loader->name());
+        auto loaded_iter = loaded.begin();
+        for (Parse_job &job : jobs) {
+            if (job.prefetch && !(cache && cache->contains(*job.filename)))
+                job.loaded = &*loaded_iter++;
+        }
+    }
+
+    // Each task parses a contiguous chunk of jobs with its own LineReader.
+    // Results are stored directly to jobs, tasks don't share anything else.
+    using job_index = std::vector<Parse_job>::size_type;
+    auto parse_jobs = [this, &jobs, cache](job_index begin, job_index end) {
+        LineReader liner;
+        for (job_index i = begin; i < end; ++i) {
+            Parse_job &job = jobs[i];
+            if (!job.prefetch)
+                continue;
+            // The contents are modified during parsing.
+            if (job.loaded && job.loaded->error == 0)
+                job.content_hash = hash_contents(job.loaded->contents);
+            job.result.emplace(construct_application(
+                *job.filename, job.rank, cache, job.loaded, liner));
+        }
+    };
+    if (pool) {
+        constexpr job_index chunk_size = 32;
+        for (job_index begin = 0; begin < jobs.size(); begin += chunk_size) {
+            pool->submit([&parse_jobs, begin,
+                          end = std::min(begin + chunk_size, jobs.size())]() {
+                parse_jobs(begin, end);
+            });
+        }
+        pool->wait();
+    } else
+        parse_jobs(0, jobs.size());
+
+    int current_rank = -1;
+    for (Parse_job &job : jobs) {
+        const string &filename = *job.filename;
+        int rank = job.rank;
+        if (rank != current_rank) {
+            current_rank = rank;
+            SPDLOG_DEBUG("AppManager: Processing rank -> {} <- (base: {})",
+                         rank, files[rank].base_path);
+        }
+
+        SPDLOG_DEBUG("AppManager:   Handling file '{}' ID: {}", filename,
+                     job.ID);
+
+        // Handle desktop file ID collision.
+        if (this->ID_to_row.count(job.ID)) {
+            SPDLOG_DEBUG("AppManager:     Collision detected, skipping!");
+            continue;
+        }
+
+        if (!job.prefetch)
+            job.result.emplace(construct_application(filename, rank, cache,
+                                                     nullptr, this->liner));
+        Application::ParseResult &result = *job.result;
+
+        switch (result.state) {
+        case Application::ParseState::parsed:
+            break;
+        case Application::ParseState::disabled:
+            SPDLOG_DEBUG("AppManager:     Desktop file is disabled: {}",
+                         result.reason);
+            // Add a disabled row that only occupies desktop ID + rank
+            this->table.content_hashes[allocate_row(job.ID, rank)] =
+                job.content_hash;
+            continue;
+        case Application::ParseState::unreadable:
+            SPDLOG_WARN("Couldn't open file '{}': {}", filename,
+                        std::system_category().message(result.error));
+            continue;
+        case Application::ParseState::invalid:
+            if (!result.key_error.empty())
+                SPDLOG_ERROR("{}: {}", filename, result.key_error);
+            SPDLOG_WARN("Desktop file '{}' is invalid: {}", filename,
+                        result.reason);
+            continue;
+        }
+
+        // Skip desktop file if its Exec key is malformed. This is deferred
+        // until the desktop file is executed in lazy mode (see
+        // load_lazy_values()).
+        if (!result.app->has_lazy_values() &&
+            !is_exec_key_valid(filename, result.app->exec))
+            continue;
+
+        row_type row = allocate_row(job.ID, rank);
+        set_application(row, std::move(*result.app));
+        this->table.content_hashes[row] = job.content_hash;
+
+        // Add the names. Desktop files are added in order of precedence, so
+        // colliding names are never transferred here.
+        replace_name_mapping<NameType::name>(row);
+        if (!this->table.generic_names[row].empty())
+            replace_name_mapping<NameType::generic_name>(row);
+    }
+
+    this->record_name_changes = true;
+}
+
+bool AppManager::is_exec_key_valid(string_view filename,
+                                   string_view exec) const {
+    auto validate_exec_key = CMDLineAssembly::validate_exec_key(exec);
+    if (!validate_exec_key)
+        return true;
+    if (this->wine_compatibility_mode) {
+        SPDLOG_DEBUG("AppManager:     Desktop file's Exec is malformed, but "
+                     "desktop file is protected by Wine compatibility mode: "
+                     "{}",
+                     *validate_exec_key);
+        return true;
+    }
+    SPDLOG_WARN("Desktop file '{}' is using invalid escape sequence in it's "
+                "Exec key, skipping: {}",
+                filename, *validate_exec_key);
+    return false;
+}
+
+bool AppManager::Name_owner::operator<(const Name_owner &other) const {
+    // Name takes precedence over GenericName of the same desktop file.
+    return std::tie(this->rank, this->sequence_number, this->is_generic) <
+           std::tie(other.rank, other.sequence_number, other.is_generic);
+}
+
+Application::ParseResult
+AppManager::parse_application(const string &filename, LoadedFile *loaded,
+                              LineReader &liner, bool lazy) const {
+    if (!loaded)
+        return Application::parse_file(filename.c_str(), liner, this->suffixes,
+                                       this->desktopenvs, lazy);
+    if (loaded->error != 0)
+        return Application::ParseResult(Application::ParseState::unreadable,
+                                        {}, {}, loaded->error);
+    return Application::parse_buffer(filename.c_str(), loaded->contents,
+                                     this->suffixes, this->desktopenvs, lazy);
+}
+
+Application::ParseResult
+AppManager::construct_application(const string &filename, int rank,
+                                  AppCache *cache, LoadedFile *loaded,
+                                  LineReader &liner) const {
+    if (!cache)
+        return parse_application(filename, loaded, liner, this->lazy_exec);
+
+    struct stat st;
+    if (stat(filename.c_str(), &st) == -1)
+        return Application::ParseResult(Application::ParseState::unreadable,
+                                        {}, {}, errno);
+
+    const AppCache::Entry *cached = cache->lookup(filename, st, rank);
+    if (cached) {
+        SPDLOG_DEBUG("AppManager:     Using cached entry.");
+        switch (cached->state) {
+        case AppCache::State::parsed:
+            return Application::ParseResult(Application::ParseState::parsed,
+                                            cached->app);
+        case AppCache::State::disabled:
+            return Application::ParseResult(Application::ParseState::disabled,
+                                            {}, cached->reason);
+        case AppCache::State::invalid:
+            return Application::ParseResult(Application::ParseState::invalid,
+                                            {}, cached->reason);
+        }
+    }
+
+    // Cached desktop files must be complete, so they are never parsed
+    // lazily.
+    Application::ParseResult result =
+        parse_application(filename, loaded, liner, false);
+    switch (result.state) {
+    case Application::ParseState::parsed:
+        cache->store(filename, AppCache::Entry(st, rank,
+                                               AppCache::State::parsed,
+                                               result.app, {}));
+        break;
+    case Application::ParseState::disabled:
+        cache->store(filename, AppCache::Entry(st, rank,
+                                               AppCache::State::disabled, {},
+                                               result.reason));
+        break;
+    case Application::ParseState::invalid:
+        cache->store(filename, AppCache::Entry(st, rank,
+                                               AppCache::State::invalid, {},
+                                               result.reason));
+        break;
+    case Application::ParseState::unreadable:
+        break;
+    }
+    return result;
+}
+
+AppManager::row_type AppManager::allocate_row(string_view ID, int rank) {
+    Application_table &table = this->table;
+    row_type row;
+    if (table.free_rows.empty()) {
+        if (table.states.size() > std::numeric_limits<row_type>::max()) {
+            SPDLOG_ERROR("AppManager: Too many desktop files!");
+            abort();
+        }
+        row = table.states.size();
+        table.states.push_back(Row_state::disabled);
+        table.ranks.push_back(rank);
+        table.IDs.emplace_back();
+        table.names.emplace_back();
+        table.generic_names.emplace_back();
+        table.apps.emplace_back();
+        table.generations.push_back(0);
+        table.sequence_numbers.push_back(0);
+        table.name_lists.push_back(no_owner_list);
+        table.generic_name_lists.push_back(no_owner_list);
+        table.content_hashes.push_back(Application_table::no_content_hash);
+    } else {
+        row = table.free_rows.back();
+        table.free_rows.pop_back();
+        table.states[row] = Row_state::disabled;
+        table.ranks[row] = rank;
+        table.content_hashes[row] = Application_table::no_content_hash;
+    }
+    table.IDs[row] = this->strings.copy(ID);
+    this->ID_to_row.emplace(table.IDs[row], row);
+    return row;
+}
+
+void AppManager::free_row(row_type row) {
+    Application_table &table = this->table;
+    clear_application(row);
+    this->ID_to_row.erase(table.IDs[row]);
+    this->strings.release_copy(table.IDs[row]);
+    table.IDs[row] = {};
+    table.states[row] = Row_state::free;
+    table.free_rows.push_back(row);
+}
+
+void AppManager::set_application(row_type row, Application app) {
+    Application_table &table = this->table;
+    clear_application(row);
+    app.intern(this->strings);
+    table.names[row] = app.name;
+    table.generic_names[row] = app.generic_name;
+    table.apps[row] = std::move(app);
+    table.sequence_numbers[row] = this->next_sequence_number++;
+    table.states[row] = Row_state::enabled;
+}
+
+void AppManager::clear_application(row_type row) {
+    Application_table &table = this->table;
+    if (table.states[row] != Row_state::enabled)
+        return;
+    table.apps[row].release_strings(this->strings);
+    table.apps[row] = Application();
+    ++table.generations[row];
+    table.names[row] = {};
+    table.generic_names[row] = {};
+    table.states[row] = Row_state::disabled;
+}
+
+Application_handle AppManager::get_handle(row_type row) const {
+    return {row, this->table.generations[row]};
+}
+
+void AppManager::transfer_name(owner_list_index list) {
+    const Name_owner &owner = this->owner_lists[list].front();
+    string_view name = owner.is_generic ? this->table.generic_names[owner.row]
+                                        : this->table.names[owner.row];
+
+    record_name_change(name);
+
+    // The keys must be replaced, because they may point to the string of the
+    // previous owner. Removal and insertion don't allocate, the slots are
+    // likely reused.
+    this->name_owners.erase(name);
+    this->name_owners.try_emplace(name, list);
+    this->name_app_mapping.erase(name);
+    this->name_app_mapping.try_emplace(name, get_handle(owner.row),
+                                       owner.is_generic);
+}
+
+AppManager::owner_list_index AppManager::allocate_owner_list() {
+    if (this->free_owner_lists.empty()) {
+        this->owner_lists.emplace_back();
+        return this->owner_lists.size() - 1;
+    }
+    owner_list_index result = this->free_owner_lists.back();
+    this->free_owner_lists.pop_back();
+    return result;
+}
+
+void AppManager::record_name_change(string_view name) {
+    if (!this->record_name_changes || this->changed_names.count(name))
+        return;
+    std::optional<Resolved_application> previous;
+    auto iter = this->name_app_mapping.find(name);
+    if (iter != this->name_app_mapping.end())
+        previous = iter->second;
+    this->changed_names.try_emplace(this->changed_name_strings.copy(name),
+                                    previous);
+}
+
+template <AppManager::NameType N>
+void AppManager::remove_name_mapping(row_type row) {
+    Application_table &table = this->table;
+    auto &lists =
+        N == NameType::name ? table.name_lists : table.generic_name_lists;
+    owner_list_index list = lists[row];
+    if (table.states[row] != Row_state::enabled || list == no_owner_list) {
+        SPDLOG_ERROR("AppManager has reached a inconsistent state. Tried to "
+                     "remove application name of row {} which isn't saved!",
+                     row);
+        abort();
+    }
+    lists[row] = no_owner_list;
+    string_view name =
+        N == NameType::name ? table.names[row] : table.generic_names[row];
+
+    std::vector<Name_owner> &owners = this->owner_lists[list];
+    Name_owner key{table.ranks[row], table.sequence_numbers[row], row,
+                   N == NameType::generic_name};
+    auto iter = std::lower_bound(owners.begin(), owners.end(), key);
+    if (iter == owners.end() || iter->row != row ||
+        iter->is_generic != key.is_generic) {
+        SPDLOG_ERROR("AppManager has reached a inconsistent state. Tried to "
+                     "remove application name '{}' which isn't saved!",
+                     name);
+        abort();
+    }
+    bool was_registered = iter == owners.begin();
+    owners.erase(iter);
+
+    if (owners.empty()) {
+        record_name_change(name);
+        this->name_app_mapping.erase(name);
+        this->name_owners.erase(name);
+        this->free_owner_lists.push_back(list);
+    } else if (was_registered)
+        transfer_name(list);
+}
+
+template <AppManager::NameType N>
+void AppManager::replace_name_mapping(row_type row) {
+    Application_table &table = this->table;
+#ifdef DEBUG
+    if (table.states[row] != Row_state::enabled) {
+        SPDLOG_ERROR("replace_name_mapping() has been called with a row which "
+                     "isn't enabled!");
+        abort();
+    }
+#endif
+    constexpr bool is_generic = N == NameType::generic_name;
+    string_view name = is_generic ? table.generic_names[row] : table.names[row];
+    auto &lists = is_generic ? table.generic_name_lists : table.name_lists;
+
+    auto [entry, inserted] = this->name_owners.try_emplace(name, no_owner_list);
+    if (inserted)
+        entry->second = allocate_owner_list();
+    owner_list_index list = entry->second;
+    lists[row] = list;
+    std::vector<Name_owner> &owners = this->owner_lists[list];
+    Name_owner owner{table.ranks[row], table.sequence_numbers[row], row,
+                     is_generic};
+    auto position = owners.insert(
+        std::upper_bound(owners.begin(), owners.end(), owner), owner);
+
+    if (inserted) {
+        record_name_change(name);
+        this->name_app_mapping.try_emplace(name, get_handle(row), is_generic);
+    } else if (position == owners.begin()) {
+        SPDLOG_DEBUG("AppManager:     Name '{}' is transferred to '{}'.", name,
+                     table.IDs[row]);
+        transfer_name(list);
+    } else {
+        SPDLOG_DEBUG("AppManager:     Name '{}' is already taken! Not "
+                     "registering.",
+                     name);
+    }
+}
+
+// Read a desktop file added at runtime. Return false and log a warning if it
+// can't be read.
+static bool read_desktop_file(const string &filename, string &contents) {
+    if (read_file(filename, contents))
+        return true;
+    SPDLOG_WARN("Couldn't open newly added desktop file '{}': {}", filename,
+                strerror(errno));
+    return false;
 }
 
 void AppManager::remove(const string &filename, const string &base_path) {
@@ -178,22 +551,23 @@ void AppManager::remove(const string &filename, const string &base_path) {
     string ID = get_desktop_id(filename, base_path);
     SPDLOG_INFO("AppManager: Removing file '{}' (ID: {}, base path: {})",
                 filename, ID, base_path);
-    auto app_iter = this->applications.find(ID);
-    if (app_iter == this->applications.end()) {
+    auto ID_iter = this->ID_to_row.find(ID);
+    if (ID_iter == this->ID_to_row.end()) {
         SPDLOG_INFO("Removal of desktop file '{}' has been requested (desktop "
                     "id: {}). Desktop id couldn't be found, ignoring...",
                     filename, ID);
         return;
     }
 
-    Managed_application &app = app_iter->second;
-    if (app.app) {
-        remove_name_mapping<NameType::name>(app);
-        if (!app.app->generic_name.empty())
-            remove_name_mapping<NameType::generic_name>(app);
+    row_type row = ID_iter->second;
+    if (this->table.states[row] == Row_state::enabled) {
+        remove_name_mapping<NameType::name>(row);
+        if (!this->table.generic_names[row].empty())
+            remove_name_mapping<NameType::generic_name>(row);
     }
 
-    this->applications.erase(app_iter);
+    free_row(row);
+    compact_strings_if_needed();
 }
 
 void AppManager::add(const string &filename, const string &base_path,
@@ -208,90 +582,175 @@ void AppManager::add(const string &filename, const string &base_path,
     // consistent.
 
     // Find a colliding app by its ID if there is a collision.
-    auto app_iter = this->applications.find(ID);
-    if (app_iter != this->applications.end()) {
+    auto ID_iter = this->ID_to_row.find(ID);
+    if (ID_iter != this->ID_to_row.end()) {
         SPDLOG_DEBUG("AppManager:   File '{}' is in ID collision.", filename);
 
-        Managed_application &managed_app = app_iter->second;
+        row_type row = ID_iter->second;
 
         // NOTE: This behaviour is different from the constructor! Read
         // doc/AppManager.md collisions.
-        if (managed_app.rank < rank) {
+        if (this->table.ranks[row] < rank) {
             SPDLOG_DEBUG("AppManager:     Older app takes precedence, skipping "
                          "addition.");
             return;
         }
 
-        // If disabled_error is raised and the program got to this point (there
+        // If the new app is disabled and the program got to this point (there
         // is a collision but the new app has a lower rank), the old app must be
         // replaced with the disabled one. The disabled app cannot provide any
         // names to name_app_mapping, only the old app has to be removed.
         bool is_disabled = false;
 
+        string contents;
+        if (!read_desktop_file(filename, contents))
+            return;
+        uint64_t content_hash = hash_contents(contents);
+        // Editors and package managers often write desktop files in several
+        // chunks or they rewrite them without changing them. Each write is
+        // reported separately. Two files of the same rank can have the same
+        // ID (a-b.desktop and a/b.desktop), so the file must be the same too.
+        // Disabled rows don't store their file, but nothing else about them
+        // would change.
+        if (this->table.ranks[row] == rank &&
+            this->table.content_hashes[row] == content_hash &&
+            (this->table.states[row] != Row_state::enabled ||
+             this->table.apps[row].location == filename)) {
+            SPDLOG_DEBUG("AppManager:     Contents haven't changed, skipping.");
+            return;
+        }
+
         // We can't overwrite the old app directly because we'll need it
-        // later. We first try to construct Application in a std::optional.
-        std::optional<Application> new_app;
-        try {
-            new_app.emplace(filename.c_str(), this->liner, this->suffixes,
-                            this->desktopenvs);
-        } catch (const disabled_error &e) {
-            SPDLOG_DEBUG("AppManager:     App is disabled: {}", e.what());
+        // later.
+        Application::ParseResult result =
+            Application::parse_buffer(filename.c_str(), contents,
+                                      this->suffixes, this->desktopenvs,
+                                      this->lazy_exec);
+        switch (result.state) {
+        case Application::ParseState::parsed:
+            break;
+        case Application::ParseState::disabled:
+            SPDLOG_DEBUG("AppManager:     App is disabled: {}", result.reason);
             is_disabled = true;
-        } catch (const std::system_error &e) {
+            break;
+        case Application::ParseState::unreadable:
             SPDLOG_WARN("Couldn't open newly added desktop file '{}': {}",
-                        filename, e.what());
+                        filename,
+                        std::system_category().message(result.error));
             return;
-        } catch (const invalid_error &e) {
+        case Application::ParseState::invalid:
+            if (!result.key_error.empty())
+                SPDLOG_ERROR("{}: {}", filename, result.key_error);
             SPDLOG_WARN("Newly added desktop file '{}' is invalid: {}",
-                        filename, e.what());
+                        filename, result.reason);
             return;
         }
 
-        if (managed_app.app) {
-            remove_name_mapping<NameType::name>(managed_app);
-            if (!managed_app.app->generic_name.empty())
-                remove_name_mapping<NameType::generic_name>(managed_app);
+        if (this->table.states[row] == Row_state::enabled) {
+            remove_name_mapping<NameType::name>(row);
+            if (!this->table.generic_names[row].empty())
+                remove_name_mapping<NameType::generic_name>(row);
+            clear_application(row);
         }
 
-        managed_app.rank = rank;
-        managed_app.app = std::move(new_app);
+        this->table.ranks[row] = rank;
+        this->table.content_hashes[row] = content_hash;
 
         if (!is_disabled) {
-            replace_name_mapping<NameType::name>(managed_app);
-            if (!managed_app.app->generic_name.empty())
-                replace_name_mapping<NameType::generic_name>(managed_app);
+            set_application(row, std::move(*result.app));
+            replace_name_mapping<NameType::name>(row);
+            if (!this->table.generic_names[row].empty())
+                replace_name_mapping<NameType::generic_name>(row);
         }
     } else {
         SPDLOG_DEBUG("AppManager:   File '{}' has no ID collision.", filename);
-        Managed_application *app_ptr;
-        try {
-            app_ptr = &this->applications
-                           .try_emplace(ID, rank, in_place_t{},
-                                        filename.c_str(), this->liner,
-                                        this->suffixes, this->desktopenvs)
-                           .first->second;
-        } catch (const disabled_error &e) {
-            SPDLOG_DEBUG("AppManager:     App is disabled: {}", e.what());
-            this->applications.try_emplace(ID, rank);
+        string contents;
+        if (!read_desktop_file(filename, contents))
+            return;
+        uint64_t content_hash = hash_contents(contents);
+        Application::ParseResult result =
+            Application::parse_buffer(filename.c_str(), contents,
+                                      this->suffixes, this->desktopenvs,
+                                      this->lazy_exec);
+        switch (result.state) {
+        case Application::ParseState::parsed:
+            break;
+        case Application::ParseState::disabled:
+            SPDLOG_DEBUG("AppManager:     App is disabled: {}", result.reason);
+            this->table.content_hashes[allocate_row(ID, rank)] = content_hash;
             return;
-        } catch (const std::system_error &e) {
+        case Application::ParseState::unreadable:
             SPDLOG_WARN("Couldn't open newly added desktop file '{}': {}",
-                        filename, e.what());
+                        filename,
+                        std::system_category().message(result.error));
             return;
-        } catch (const invalid_error &e) {
+        case Application::ParseState::invalid:
+            if (!result.key_error.empty())
+                SPDLOG_ERROR("{}: {}", filename, result.key_error);
             SPDLOG_WARN("Newly added desktop file '{}' is invalid: {}",
-                        filename, e.what());
+                        filename, result.reason);
             return;
         }
 
-        Managed_application &app = *app_ptr;
+        row_type row = allocate_row(ID, rank);
+        set_application(row, std::move(*result.app));
+        this->table.content_hashes[row] = content_hash;
 
         // The new application must be a poppulated one, this function would
         // have returned by now if that wasn't the case.
-        replace_name_mapping<NameType::name>(app);
-        if (!app.app->generic_name.empty())
-            replace_name_mapping<NameType::generic_name>(app);
+        replace_name_mapping<NameType::name>(row);
+        if (!this->table.generic_names[row].empty())
+            replace_name_mapping<NameType::generic_name>(row);
+    }
+    compact_strings_if_needed();
+}
+
+void AppManager::compact_strings_if_needed() {
+    if (!this->strings.should_compact())
+        return;
+    SPDLOG_DEBUG("AppManager: Compacting string pool ({} bytes used, {} bytes "
+                 "live).",
+                 this->strings.used_bytes(), this->strings.live_bytes());
+
+    // All live strings are moved to a new pool. The keys of ID_to_row and
+    // name_app_mapping must point to the new strings.
+    Application_table &table = this->table;
+    StringPool next;
+    this->ID_to_row.clear();
+    for (row_type row = 0; row < table.states.size(); ++row) {
+        if (table.states[row] == Row_state::free)
+            continue;
+        table.IDs[row] = next.copy(table.IDs[row]);
+        this->ID_to_row.emplace(table.IDs[row], row);
+        if (table.states[row] == Row_state::enabled) {
+            table.apps[row].intern(next);
+            table.names[row] = table.apps[row].name;
+            table.generic_names[row] = table.apps[row].generic_name;
+        }
+    }
+    name_app_mapping_type mapping;
+    mapping.reserve(this->name_app_mapping.size());
+    for (const auto &[name, resolved] : this->name_app_mapping) {
+        mapping.try_emplace(resolved.is_generic
+                                ? table.generic_names[resolved.handle.slot]
+                                : table.names[resolved.handle.slot],
+                            resolved);
+    }
+    this->name_app_mapping = std::move(mapping);
+    FlatHashMap<string_view, owner_list_index> owners;
+    owners.reserve(this->name_owners.size());
+    for (const auto &[name, list] : this->name_owners) {
+        const Name_owner &owner = this->owner_lists[list].front();
+        owners.try_emplace(owner.is_generic ? table.generic_names[owner.row]
+                                            : table.names[owner.row],
+                           list);
     }
+    this->name_owners = std::move(owners);
+    this->strings = std::move(next);
+}
+
+const StringPool &AppManager::view_string_pool() const {
+    return this->strings;
 }
 
 const AppManager::name_app_mapping_type &
@@ -299,24 +758,50 @@ AppManager::view_name_app_mapping() const {
     return this->name_app_mapping;
 }
 
-AppManager::applications_type::size_type AppManager::count() const {
-    return this->applications.size();
+std::vector<AppManager::Name_change> AppManager::take_name_changes() {
+    std::vector<Name_change> result;
+    for (const auto &[name, previous] : this->changed_names) {
+        std::optional<Resolved_application> current;
+        auto iter = this->name_app_mapping.find(name);
+        if (iter != this->name_app_mapping.end())
+            current = iter->second;
+
+        if (previous && current) {
+            if (previous->handle == current->handle &&
+                previous->is_generic == current->is_generic)
+                continue;
+            result.emplace_back(Name_change::Type::rebound, string(name),
+                                previous, current);
+        } else if (previous)
+            result.emplace_back(Name_change::Type::removed, string(name),
+                                previous, current);
+        else if (current)
+            result.emplace_back(Name_change::Type::added, string(name),
+                                previous, current);
+    }
+    this->changed_names.clear();
+    this->changed_name_strings = StringPool();
+    return result;
+}
+
+std::size_t AppManager::count() const {
+    return this->table.states.size() - this->table.free_rows.size();
 }
 
 // This function should be used only for debugging.
 void AppManager::check_inner_state() const {
     // The lifetimes in this class are kinda funky because the lifetime
-    // of everything indirectly depends on applications.
+    // of everything indirectly depends on the table.
     // An example of such error is having an element in name_app_mapping
     // whose key (remember that the key of name_app_mapping is
     // string_view which has its lifetime tied to the corresponding
-    // element in applications) is corrupted because the desktop file in
-    // applications has been removed and the name in name_app_mapping
+    // row in table) is corrupted because the desktop file in
+    // table has been removed and the name in name_app_mapping
     // has stayed. If that happens, the element in name_app_mapping will
     // contain garbage data.
     // If AppManager is in a consistent state, all desktop names in
     // name_app_mapping should be null terminated because they point to
-    // std::string which is null terminated. We can use this fact to
+    // strings in StringPool which are null terminated. We can use this fact to
     // detect whether there is garbage data. If everything is
     // implemented well, this condition will never be true.
     // Note that this detection of faulty memory access isn't perfect.
@@ -328,28 +813,101 @@ void AppManager::check_inner_state() const {
     // By the way, we can't just do desktop_ID[desktop_ID.size()]
     // because that is undefined behavior. desktop_ID.data() +
     // desktop_ID.size() is still undefined behavior, but it "fixes"
-    // _GLIBCXX_DEBUG errors. All string_views point to std::string
-    // which are terminated by \0 so we aren't accessing bad memory.
-    for (const auto &[ID, app] : this->applications) {
+    // _GLIBCXX_DEBUG errors. All string_views point to strings which
+    // are terminated by \0 so we aren't accessing bad memory.
+    const Application_table &table = this->table;
+    auto rows = table.states.size();
+    if (table.ranks.size() != rows || table.IDs.size() != rows ||
+        table.names.size() != rows || table.generic_names.size() != rows ||
+        table.apps.size() != rows || table.generations.size() != rows ||
+        table.sequence_numbers.size() != rows ||
+        table.name_lists.size() != rows ||
+        table.generic_name_lists.size() != rows ||
+        table.content_hashes.size() != rows) {
+        SPDLOG_ERROR("AppManager check error: Columns of the application "
+                     "table have different sizes!");
+        abort();
+    }
+    if (this->ID_to_row.size() != count()) {
+        SPDLOG_ERROR("AppManager check error: ID_to_row doesn't contain all "
+                     "desktop file IDs!");
+        abort();
+    }
+    for (row_type row = 0; row < rows; ++row) {
+        if (table.states[row] == Row_state::free) {
+            if (std::find(table.free_rows.begin(), table.free_rows.end(),
+                          row) == table.free_rows.end()) {
+                SPDLOG_ERROR("AppManager check error: A free row in the "
+                             "application table isn't reusable!");
+                abort();
+            }
+            continue;
+        }
+        string_view ID = table.IDs[row];
         if (ID.empty()) {
             SPDLOG_ERROR("AppManager check error: A managed application in "
-                         "applications has a empty desktop file ID!");
+                         "the table has a empty desktop file ID!");
+            abort();
+        }
+        auto ID_iter = this->ID_to_row.find(ID);
+        if (ID_iter == this->ID_to_row.end() || ID_iter->second != row ||
+            ID_iter->first.data() != ID.data()) {
+            SPDLOG_ERROR("AppManager check error: Desktop file ID '{}' isn't "
+                         "properly indexed!",
+                         ID);
             abort();
         }
-        if (app.rank < 0) {
+        if (table.ranks[row] < 0) {
             SPDLOG_ERROR("AppManager check error: A managed application in "
-                         "applications has a negative rank!");
+                         "the table has a negative rank!");
+            abort();
+        }
+        const Application *app = resolve(get_handle(row));
+        if ((app != nullptr) != !table.apps[row].name.empty()) {
+            SPDLOG_ERROR("AppManager check error: State of a row doesn't "
+                         "match its application!");
+            abort();
+        }
+        if ((app != nullptr) != (table.name_lists[row] != no_owner_list) ||
+            (app != nullptr && !app->generic_name.empty()) !=
+                (table.generic_name_lists[row] != no_owner_list)) {
+            SPDLOG_ERROR("AppManager check error: Names of desktop file ID "
+                         "'{}' aren't properly indexed!",
+                         ID);
+            abort();
+        }
+        if (!app)
+            continue;
+        if (table.names[row].data() != app->name.data() ||
+            table.generic_names[row].data() != app->generic_name.data()) {
+            SPDLOG_ERROR("AppManager check error: Name columns of the "
+                         "application table are outdated!");
             abort();
         }
-        if (app.app && (app.app->exec.empty() ||
-                        app.app->exec[app.app->exec.size()] != '\0')) {
+        if (!app->has_lazy_values() &&
+            (app->exec.empty() ||
+             app->exec.data()[app->exec.size()] != '\0')) {
             SPDLOG_ERROR("AppManager check error: A managed application in "
-                         "applications might not have been constructed!");
+                         "the table might not have been constructed!");
             abort();
         }
     }
 
-    for (const auto &[name, resolved] : this->name_app_mapping) {
+    if (this->name_owners.size() != this->name_app_mapping.size() ||
+        this->owner_lists.size() - this->free_owner_lists.size() !=
+            this->name_owners.size()) {
+        SPDLOG_ERROR("AppManager check error: name_owners and "
+                     "name_app_mapping contain different names!");
+        abort();
+    }
+    for (const auto &[name, list] : this->name_owners) {
+        if (list >= this->owner_lists.size()) {
+            SPDLOG_ERROR("AppManager check error: Name '{}' has an invalid "
+                         "owner list!",
+                         name);
+            abort();
+        }
+        const std::vector<Name_owner> &owners = this->owner_lists[list];
         if (name.empty()) {
             SPDLOG_ERROR(
                 "AppManager check error: A name in name_app_mapping is empty!");
@@ -362,37 +920,82 @@ void AppManager::check_inner_state() const {
                 "likely corrupted!");
             abort();
         }
-        using value_type = decltype(this->applications)::value_type;
-        if (std::find_if(
-                applications.cbegin(), applications.cend(),
-                [&name = name](const value_type &val) {
-                    return val.second.app &&
-                           (val.second.app->name.data() == name.data() ||
-                            val.second.app->generic_name.data() == name.data());
-                }) == applications.cend()) {
+        if (owners.empty() || !std::is_sorted(owners.begin(), owners.end())) {
+            SPDLOG_ERROR("AppManager check error: Owners of name '{}' aren't "
+                         "properly sorted!",
+                         name);
+            abort();
+        }
+        for (const Name_owner &owner : owners) {
+            if (owner.row >= rows ||
+                table.states[owner.row] != Row_state::enabled ||
+                owner.rank != table.ranks[owner.row] ||
+                owner.sequence_number != table.sequence_numbers[owner.row] ||
+                (owner.is_generic ? table.generic_name_lists[owner.row]
+                                  : table.name_lists[owner.row]) != list ||
+                (owner.is_generic ? table.generic_names[owner.row]
+                                  : table.names[owner.row]) != name) {
+                SPDLOG_ERROR("AppManager check error: An owner of name '{}' "
+                             "is outdated!",
+                             name);
+                abort();
+            }
+        }
+
+        const Name_owner &first = owners.front();
+        if (name.data() != (first.is_generic ? table.generic_names[first.row]
+                                             : table.names[first.row])
+                               .data()) {
             SPDLOG_ERROR(
                 "AppManager check error: A name in name_app_mapping points "
-                "to an unknown location not in applications!");
+                "to an unknown location not in the table!");
             abort();
         }
-        if (std::find_if(applications.cbegin(), applications.cend(),
-                         [&ptr = resolved.app](const value_type &val) {
-                             return val.second.app && &*val.second.app == ptr;
-                         }) == applications.cend()) {
+        auto resolved = this->name_app_mapping.find(name);
+        if (resolved == this->name_app_mapping.end() ||
+            resolved->first.data() != name.data() ||
+            resolved->second.handle != get_handle(first.row) ||
+            resolved->second.is_generic != first.is_generic) {
             SPDLOG_ERROR(
                 "AppManager check error: An managed application pointer in "
-                "name_app_mapping points to an unknown managed application "
-                "not in applications!");
+                "name_app_mapping doesn't point to the owner of the name!");
             abort();
         }
     }
 }
 
-std::optional<std::reference_wrapper<const Application>>
+const Application *AppManager::resolve(Application_handle handle) const {
+    const Application_table &table = this->table;
+    if (handle.slot >= table.states.size() ||
+        table.states[handle.slot] != Row_state::enabled ||
+        table.generations[handle.slot] != handle.generation)
+        return nullptr;
+    return &table.apps[handle.slot];
+}
+
+std::optional<Application_handle>
 AppManager::lookup_by_ID(const string &ID) const {
-    auto result = this->applications.find(ID);
-    if (result == this->applications.end())
+    auto result = this->ID_to_row.find(ID);
+    if (result == this->ID_to_row.end() ||
+        this->table.states[result->second] != Row_state::enabled)
         return {};
     else
-        return result->second.app;
+        return get_handle(result->second);
+}
+
+Application::ParseResult
+AppManager::load_lazy_values(const Application &app) const {
+    if (!app.has_lazy_values())
+        return Application::ParseResult(Application::ParseState::parsed, app);
+    LineReader liner;
+    // location is NUL terminated.
+    Application::ParseResult result = Application::parse_file(
+        app.location.data(), liner, this->suffixes, this->desktopenvs);
+    // The Exec key couldn't be validated in the ctor.
+    if (result.state == Application::ParseState::parsed &&
+        !is_exec_key_valid(app.location, result.app->exec))
+        return Application::ParseResult(
+            Application::ParseState::invalid, {},
+            "Exec key contains an invalid escape sequence.");
+    return result;
 }
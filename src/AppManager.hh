@@ -27,16 +27,22 @@
 #include <functional>
 #include <limits>
 #include <optional>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string>
 #include <string_view>
-#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "AppCache.hh"
 #include "Application.hh"
+#include "DesktopFileLoader.hh"
+#include "FlatHashMap.hh"
 #include "LineReader.hh"
 #include "LocaleSuffixes.hh"
+#include "StringPool.hh"
+#include "ThreadPool.hh"
 #include "Utilities.hh"
 
 using std::string;
@@ -48,20 +54,6 @@ using std::string_view;
 std::string get_desktop_id(std::string filename);
 std::string get_desktop_id(const std::string &filename, std::string_view base);
 
-// This class is basically an Application with added info needed for AppManager.
-struct Managed_application
-{
-    // If app is unoccupied, it means that the app is disabled (using Hidden or
-    // OnlyShowIn/NotShowIn), it doesn't provide Name nor GenericName but still
-    // participates in desktop ID collision mechanism
-    std::optional<Application> app;
-    int rank;
-
-    template <typename... Args>
-    Managed_application(int rank, Args &&...forwarded)
-        : app(std::forward<Args>(forwarded)...), rank(rank) {}
-};
-
 struct Desktop_file_rank
 {
     string base_path;
@@ -70,12 +62,25 @@ struct Desktop_file_rank
     Desktop_file_rank(string b, std::vector<string> f);
 };
 
+// Applications managed by AppManager are referred to by handles. A handle
+// stays valid until its desktop file is removed or replaced, it doesn't become
+// valid again when its slot is reused. Use AppManager::resolve() to access the
+// Application.
+struct Application_handle
+{
+    uint32_t slot;
+    uint32_t generation;
+
+    bool operator==(const Application_handle &other) const;
+    bool operator!=(const Application_handle &other) const;
+};
+
 struct Resolved_application
 {
-    const Application *app;
+    Application_handle handle;
     bool is_generic;
 
-    Resolved_application(const Application *app, bool is_generic);
+    Resolved_application(Application_handle handle, bool is_generic);
 };
 
 // This class represents the input to the ctor of AppManager.
@@ -87,186 +92,255 @@ using Desktop_file_list = std::vector<Desktop_file_rank>;
 
 class AppManager
 {
-    using applications_type =
-        std::unordered_map<string /*desktop ID*/, Managed_application>;
-
 public:
     using name_app_mapping_type =
-        std::unordered_map<string_view /*(Generic)Name*/, Resolved_application>;
+        FlatHashMap<string_view /*(Generic)Name*/, Resolved_application>;
+
+    // A change of a name in name_app_mapping. Users of the mapping can apply
+    // these instead of reprocessing all names after each modification.
+    struct Name_change
+    {
+        enum class Type {
+            // The name has been added to name_app_mapping.
+            added,
+            // The name has been removed from name_app_mapping.
+            removed,
+            // The name refers to a different Application. Its desktop file
+            // has been replaced or the name has been transferred to another
+            // desktop file because of a collision.
+            rebound
+        };
+
+        Type type;
+        string name;
+        // The binding of the name before the change. This is set for removed
+        // and rebound names. Its handle might no longer be valid.
+        std::optional<Resolved_application> previous;
+        // The current binding of the name. This is set for added and rebound
+        // names.
+        std::optional<Resolved_application> current;
+
+        Name_change(Type type, string name,
+                    std::optional<Resolved_application> previous,
+                    std::optional<Resolved_application> current);
+    };
 
     AppManager(const AppManager &) = delete;
     AppManager(AppManager &&) = delete;
     void operator=(const AppManager &) = delete;
     void operator=(AppManager &&) = delete;
 
+    // If cache isn't nullptr, it is used to skip parsing of desktop files
+    // which haven't changed since the cache has been saved. Parsed desktop
+    // files are stored to it. The caller is responsible for saving the cache.
+    // If loader isn't nullptr, all desktop files of a rank (which aren't
+    // cached) are read at once through it before they are parsed.
+    // If pool isn't nullptr, desktop files are parsed in it in parallel. The
+    // result is the same as if they were parsed sequentially.
+    // If lazy_exec is true, Exec and Path keys aren't parsed (unless they are
+    // retrieved from cache) and Exec keys aren't validated. Applications
+    // must be passed through load_lazy_values() before they are executed, it
+    // validates them.
     AppManager(Desktop_file_list files, stringlist_t desktopenvs,
-               LocaleSuffixes suffixes, bool wine_compatibility_mode = false);
+               LocaleSuffixes suffixes, bool wine_compatibility_mode = false,
+               AppCache *cache = nullptr, DesktopFileLoader *loader = nullptr,
+               ThreadPool *pool = nullptr, bool lazy_exec = false);
 
     void remove(const string &filename, const string &base_path);
     // This function accepts path to the desktop file relative to $XDG_DATA_DIRS
     // and its rank within $XDG_DATA_DIRS
     void add(const string &filename, const string &base_path, int rank);
-    applications_type::size_type count() const;
+    // Return the number of desktop IDs (including disabled ones).
+    std::size_t count() const;
     const name_app_mapping_type &view_name_app_mapping() const;
 
-    // This function should be used only for debugging.
+    // Return changes of name_app_mapping made by add() and remove() since the
+    // last call (or since construction). Each name is reported at most once,
+    // the change describes the difference between the state of the mapping at
+    // the last call and its current state. Names which have been modified but
+    // ended up with their original binding aren't reported.
+    std::vector<Name_change> take_name_changes();
+
+    // These functions should be used only for debugging.
     void check_inner_state() const;
+    const StringPool &view_string_pool() const;
+
+    // Return the Application referred to by handle or nullptr if the handle is
+    // no longer valid. The returned pointer is invalidated by add() and
+    // remove().
+    const Application *resolve(Application_handle handle) const;
 
     // This function will never get called in a typical j4dd session. It is used
     // only for converting the old history format to the new one.
-    std::optional<std::reference_wrapper<const Application>>
-    lookup_by_ID(const string &ID) const;
+    std::optional<Application_handle> lookup_by_ID(const string &ID) const;
+
+    // Parse the desktop file of app again with all keys. This is needed only
+    // if app.has_lazy_values(). The desktop file may have changed in the
+    // meantime, so the result may differ from app. The result is invalid if
+    // the Exec key is malformed (unless Wine compatibility mode is enabled).
+    Application::ParseResult load_lazy_values(const Application &app) const;
 
 private:
     enum class NameType { name, generic_name };
 
-    // Cleanly remove a name mapping from name_lookup. Collisions are handled
-    // properly.
+    using row_type = uint32_t;
+
+    enum class Row_state : unsigned char {
+        // The row isn't used, it will be reused by the next allocate_row().
+        free,
+        // The desktop file is disabled (using Hidden or OnlyShowIn/NotShowIn).
+        // It doesn't provide Name nor GenericName but still participates in
+        // desktop ID collision mechanism. Only its ID and rank are stored.
+        disabled,
+        enabled
+    };
+
+    // A desktop file which provides a (Generic)Name.
+    struct Name_owner
+    {
+        int rank;
+        uint64_t sequence_number;
+        row_type row;
+        bool is_generic;
+
+        // Owners are ordered by their precedence.
+        bool operator<(const Name_owner &other) const;
+    };
+
+    // Owners of each name are stored in a list sorted by their precedence.
+    // The first one is registered in name_app_mapping. Collisions are rare, so
+    // a sorted vector is used instead of a tree. Lists are referred to by
+    // their index in owner_lists.
+    using owner_list_index = uint32_t;
+    static constexpr owner_list_index no_owner_list =
+        std::numeric_limits<owner_list_index>::max();
+
+    // Desktop files are stored in a table with a row for each desktop ID. The
+    // table is a struct of arrays, all columns have the same size. It is also
+    // a slot map: Application_handle::slot is a row and the generation of the
+    // row is incremented when its Application is removed.
+    struct Application_table
+    {
+        std::vector<Row_state> states;
+        std::vector<int> ranks;
+        // These point to strings.
+        std::vector<string_view> IDs;
+        // These are the same string_views as the ones in apps. They are empty
+        // in disabled and free rows.
+        std::vector<string_view> names;
+        std::vector<string_view> generic_names;
+        // Applications of disabled and free rows are empty.
+        std::vector<Application> apps;
+        std::vector<uint32_t> generations;
+        // Order in which the rows have been enabled. It breaks ties between
+        // colliding names of the same rank.
+        std::vector<uint64_t> sequence_numbers;
+        // Back pointers to the owner lists which contain the row's Name and
+        // GenericName. They are no_owner_list if the row doesn't provide the
+        // name.
+        std::vector<owner_list_index> name_lists;
+        std::vector<owner_list_index> generic_name_lists;
+        // hash_contents() of the desktop file or no_content_hash if it isn't
+        // known (the desktop file has been read by LineReader or retrieved
+        // from cache). add() skips desktop files whose contents haven't
+        // changed.
+        std::vector<uint64_t> content_hashes;
+        static constexpr uint64_t no_content_hash = 0;
+        // Free rows are reused before the table grows.
+        std::vector<row_type> free_rows;
+    };
+
+    // Construct an Application, possibly by retrieving it from cache. Cached
+    // disabled and invalid desktop files return their original reason. If
+    // loaded isn't nullptr, it contains the desktop file read by
+    // DesktopFileLoader. Otherwise liner is used to read it. This function may
+    // be called from multiple threads at once as long as each of them uses
+    // its own liner.
+    Application::ParseResult construct_application(const string &filename,
+                                                   int rank, AppCache *cache,
+                                                   LoadedFile *loaded,
+                                                   LineReader &liner) const;
+    Application::ParseResult parse_application(const string &filename,
+                                               LoadedFile *loaded,
+                                               LineReader &liner,
+                                               bool lazy) const;
+    // Return false (and log a warning) if the desktop file must be skipped
+    // because its Exec key is malformed. Malformed Exec keys are tolerated in
+    // Wine compatibility mode.
+    bool is_exec_key_valid(string_view filename, string_view exec) const;
+
+    // Add a disabled row for ID.
+    row_type allocate_row(string_view ID, int rank);
+    // Remove the row, its names must have been removed from name_app_mapping.
+    void free_row(row_type row);
+    // Make the row enabled. Strings of app are moved to the string pool.
+    void set_application(row_type row, Application app);
+    // Make the row disabled, its names must have been removed from
+    // name_app_mapping. All handles of the row are invalidated.
+    void clear_application(row_type row);
+    Application_handle get_handle(row_type row) const;
+
+    // Replace the string pool with a new generation if too much of its memory
+    // is wasted by strings of removed applications.
+    void compact_strings_if_needed();
+
+    // Cleanly remove a name mapping of an enabled row from name_app_mapping
+    // and name_owners. Collisions are handled properly: the name is passed to
+    // the next owner of the name (if there is one).
     // Removing a name and a generic_name is practically the same operation.
-    // This is why this function exists. remove_name_mapping<NameType::name>
-    // removes a Name and remove_name_mapping<NameType::generic_name> removes a
-    // GenericName.
-    // It is **guaranteed** that to_remove.app is populated and not empty.
-    template <NameType N>
-    void remove_name_mapping(Managed_application &to_remove) {
-#ifdef DEBUG
-        if (!to_remove.app) {
-            SPDLOG_ERROR(
-                "remove_app_mapping() has been called with an empty app!");
-            abort();
-        }
-#endif
-        string &name = N == NameType::name ? to_remove.app->name
-                                           : to_remove.app->generic_name;
-
-        auto name_lookup_iter = name_app_mapping.find(name);
-        if (name_lookup_iter == name_app_mapping.end()) {
-            SPDLOG_ERROR(
-                "AppManager has reached a inconsistent state. Tried to "
-                "remove application name '{}' which isn't saved!",
-                name);
-            abort();
-        }
-
-        // The order of insertions and removals is crucial here. The keys of
-        // name_lookup are a string_view which are basically a pointer to
-        // applications. The application which currently owns the name
-        // (it's pointer is associated with the name in name_lookup) must also
-        // own the key to maintain the lifetime of the key.
-        if (name_lookup_iter->second.app == &*to_remove.app) {
-            name_app_mapping.erase(name_lookup_iter);
-            // We will look through all applications to find one with the same
-            // (Generic)Name to replace the current one. The match with the
-            // lowest rank wins.
-            string_view best_match_name;
-            const Application *best_match_app;
-            bool best_match_is_generic;
-            int best_match_rank = std::numeric_limits<int>::max();
-
-            for (auto iter = this->applications.begin();
-                 iter != this->applications.end(); ++iter) {
-                Managed_application &managed_app = iter->second;
-                // Skip unpopulated apps
-                if (!managed_app.app)
-                    continue;
-                Application &app = *managed_app.app;
-
-                if (app.name == name || app.generic_name == name) {
-                    if (&managed_app == &to_remove)
-                        continue;
-                    // When there are multiple candidates in the same rank,
-                    // the replacement isn't chosen "deterministically", it
-                    // isn't sorted so the choice depends on the ordering of
-                    // unordered_map.
-
-                    // We are looking for the match with the lowest rank.
-                    // This match has a higher rank (or the same), we aren't
-                    // interested in it.
-                    if (managed_app.rank >= best_match_rank)
-                        continue;
-
-                    // We have found a better match. We have to know whether we
-                    // have matched a Name or a GenericName.
-                    best_match_app = &app;
-                    best_match_rank = managed_app.rank;
-                    if (app.name == name) {
-                        best_match_name = string_view(app.name);
-                        best_match_is_generic = false;
-                    } else {
-                        best_match_name = string_view(app.generic_name);
-                        best_match_is_generic = true;
-                    }
-                }
-            }
-
-            if (best_match_rank != std::numeric_limits<int>::max()) {
-                this->name_app_mapping.try_emplace(
-                    best_match_name, best_match_app, best_match_is_generic);
-            }
-        }
-    }
-
-    // Add a name mapping, possibly replacing a colliding one if a collision
-    // exists and the new managed app has a lower rank.
-    // It is **guaranteed** that to_remove.app is populated and not empty.
-    template <NameType N>
-    void replace_name_mapping(Managed_application &to_add) {
-#ifdef DEBUG
-        if (!to_add.app) {
-            SPDLOG_ERROR(
-                "remove_app_mapping() has been called with an empty app!");
-            abort();
-        }
-#endif
-        string &name =
-            N == NameType::name ? to_add.app->name : to_add.app->generic_name;
-
-        auto result = this->name_app_mapping.try_emplace(
-            name, &*to_add.app, N == NameType::generic_name);
-        if (result.second)
-            return;
-
-        auto colliding_app_ptr = result.first->second.app;
-
-        using value_type = typename decltype(this->applications)::value_type;
-        auto colliding_iter = std::find_if(
-            this->applications.begin(), this->applications.end(),
-            [&colliding_app_ptr](const value_type &val) {
-                return val.second.app && &*val.second.app == colliding_app_ptr;
-            });
-        if (colliding_iter == this->applications.end()) {
-            SPDLOG_ERROR(
-                "AppManager has reached a inconsistent state. Couldn't "
-                "find Application* for name '{}' when there should be one.",
-                name);
-            abort();
-        }
-        Managed_application &colliding_managed_app = colliding_iter->second;
-
-        int &old_rank = colliding_managed_app.rank;
-        if (to_add.rank < old_rank) {
-            // We must remove and readd the element if it must be replaced.
-            // We can't just change the value of name_lookup's element because
-            // the key of the element is a string_view. A replacement of the
-            // pointer would mess up the lifetime of the key.
-            this->name_app_mapping.erase(result.first);
-            this->name_app_mapping.try_emplace(name, &*to_add.app,
-                                               N == NameType::generic_name);
-        }
-    }
-
+    // remove_name_mapping<NameType::name> removes a Name and
+    // remove_name_mapping<NameType::generic_name> removes a GenericName.
+    template <NameType N> void remove_name_mapping(row_type row);
+
+    // Add a name mapping of an enabled row, possibly replacing a colliding
+    // one if a collision exists and the new row has a lower rank.
+    template <NameType N> void replace_name_mapping(row_type row);
+
+    // Make the first owner of the list the owner of the name in
+    // name_app_mapping. The keys of name_app_mapping and name_owners are
+    // replaced with the owner's string.
+    void transfer_name(owner_list_index list);
+    owner_list_index allocate_owner_list();
+
+    // This must be called before name is added to name_app_mapping, removed
+    // from it or rebound. It remembers the original binding of the name for
+    // take_name_changes().
+    void record_name_change(string_view name);
+
+    // Strings of all applications and desktop IDs are stored here.
+    StringPool strings;
     // This contains the actual data. All other containers depend on this
-    // unordered_map. This list should be modified first when adding something
-    // and it should be modified last when removing something for lifetime
+    // table. This table should be modified first when adding something and
+    // it should be modified last when removing something for lifetime
     // reasons.
-    applications_type applications;
+    Application_table table;
+    FlatHashMap<string_view /*desktop ID*/, row_type> ID_to_row;
     // Map used for lookup and name listing.
     name_app_mapping_type name_app_mapping;
+    // This contains the same names as name_app_mapping (and their keys point
+    // to the same strings), but it refers to lists of all desktop files which
+    // provide them, including the ones which lost a collision.
+    FlatHashMap<string_view /*(Generic)Name*/, owner_list_index> name_owners;
+    std::vector<std::vector<Name_owner>> owner_lists;
+    // Emptied lists are reused.
+    std::vector<owner_list_index> free_owner_lists;
+    uint64_t next_sequence_number = 0;
+    // Names modified since the last take_name_changes() and their binding at
+    // that time. Changes aren't recorded in the constructor. Keys point to
+    // changed_name_strings, because the strings of AppManager may be removed
+    // before the changes are taken.
+    FlatHashMap<string_view /*(Generic)Name*/,
+                std::optional<Resolved_application>>
+        changed_names;
+    StringPool changed_name_strings;
+    bool record_name_changes = false;
 
     // Things needed to construct Application:
     LineReader liner;
     LocaleSuffixes suffixes;
     stringlist_t desktopenvs;
+    bool wine_compatibility_mode;
+    bool lazy_exec;
 };
 
 #endif
@@ -21,15 +21,188 @@
 
 #include <cstring>
 #include <errno.h>
-#include <memory>
-#include <stdio.h>
+#include <stdint.h>
 #include <string_view>
-#include <sys/types.h>
 #include <system_error>
 #include <utility>
 
 #include "LineReader.hh"
 
+// Keys of the [Desktop Entry] group recognized by Application. They are looked
+// up in a perfect hash table generated at compile time.
+namespace DesktopEntryKeys
+{
+enum class Key : unsigned char {
+    unknown,
+    name,
+    generic_name,
+    exec,
+    path,
+    only_show_in,
+    not_show_in,
+    hidden,
+    no_display,
+    terminal
+};
+
+struct KeyName
+{
+    std::string_view name;
+    Key key;
+};
+
+constexpr KeyName key_names[] = {
+    {"Name",        Key::name        },
+    {"GenericName", Key::generic_name},
+    {"Exec",        Key::exec        },
+    {"Path",        Key::path        },
+    {"OnlyShowIn",  Key::only_show_in},
+    {"NotShowIn",   Key::not_show_in },
+    {"Hidden",      Key::hidden      },
+    {"NoDisplay",   Key::no_display  },
+    {"Terminal",    Key::terminal    },
+};
+constexpr size_t key_count = sizeof key_names / sizeof key_names[0];
+
+constexpr unsigned table_bits = 4;
+constexpr size_t table_size = 1 << table_bits;
+
+// Keys are identified by their length and their first and last character. This
+// is mixed by multiplicative hashing. Keys are never empty.
+constexpr size_t hash(std::string_view key, uint32_t multiplier) {
+    uint32_t mixed = ((uint32_t)key.size() * 31 + (unsigned char)key[0]) * 31 +
+                     (unsigned char)key.back();
+    return (uint32_t)(mixed * multiplier) >> (32 - table_bits);
+}
+
+constexpr bool is_perfect(uint32_t multiplier) {
+    bool used[table_size] = {};
+    for (const KeyName &key_name : key_names) {
+        size_t slot = hash(key_name.name, multiplier);
+        if (used[slot])
+            return false;
+        used[slot] = true;
+    }
+    return true;
+}
+
+// Try pseudorandom multipliers until a perfect one is found.
+constexpr uint32_t find_multiplier() {
+    uint32_t multiplier = 1;
+    for (int i = 0; i < 10000; ++i) {
+        multiplier = multiplier * 1103515245u + 12345u;
+        if (is_perfect(multiplier))
+            return multiplier;
+    }
+    return 0;
+}
+
+constexpr uint32_t multiplier = find_multiplier();
+static_assert(multiplier != 0, "Couldn't find a perfect hash for keys!");
+
+struct Table
+{
+    // Index to key_names + 1, 0 is an empty slot.
+    unsigned char slots[table_size];
+};
+
+constexpr Table make_table() {
+    Table table{};
+    for (size_t i = 0; i < key_count; ++i)
+        table.slots[hash(key_names[i].name, multiplier)] = i + 1;
+    return table;
+}
+
+constexpr Table table = make_table();
+
+constexpr Key lookup(std::string_view key) {
+    unsigned char slot = table.slots[hash(key, multiplier)];
+    if (slot == 0 || key_names[slot - 1].name != key)
+        return Key::unknown;
+    return key_names[slot - 1].key;
+}
+
+static_assert(lookup("Name") == Key::name);
+static_assert(lookup("Terminal") == Key::terminal);
+}; // namespace DesktopEntryKeys
+
+bool Application::has_lazy_values() const {
+    return this->lazy;
+}
+
+Application::Application(const Application &other)
+    : terminal(other.terminal), lazy(other.lazy) {
+    if (other.storage) {
+        this->name = other.name;
+        this->generic_name = other.generic_name;
+        this->exec = other.exec;
+        this->path = other.path;
+        this->location = other.location;
+        this->id = other.id;
+        this->storage = other.storage;
+    } else
+        store(other.name, other.generic_name, other.exec, other.path,
+              other.location, other.id);
+}
+
+Application &Application::operator=(const Application &other) {
+    return *this = Application(other);
+}
+
+void Application::store(std::string_view name, std::string_view generic_name,
+                        std::string_view exec, std::string_view path,
+                        std::string_view location, std::string_view id) {
+    size_t size = name.size() + generic_name.size() + exec.size() +
+                  path.size() + location.size() + id.size() + 6;
+    std::shared_ptr<char[]> buffer(new char[size]);
+    char *pos = buffer.get();
+    auto copy = [&pos](std::string_view str) {
+        // str.data() may be NULL if str is empty.
+        if (!str.empty())
+            memcpy(pos, str.data(), str.size());
+        pos[str.size()] = '\0';
+        std::string_view result(pos, str.size());
+        pos += str.size() + 1;
+        return result;
+    };
+    this->name = copy(name);
+    this->generic_name = copy(generic_name);
+    this->exec = copy(exec);
+    this->path = copy(path);
+    this->location = copy(location);
+    this->id = copy(id);
+    this->storage = std::move(buffer);
+}
+
+void Application::intern(StringPool &pool) {
+    for (std::string_view *field : {&this->name, &this->exec, &this->location})
+        *field = pool.copy(*field);
+    for (std::string_view *field :
+         {&this->generic_name, &this->path, &this->id})
+        *field = pool.acquire(*field);
+    this->storage.reset();
+}
+
+void Application::release_strings(StringPool &pool) const {
+    for (std::string_view field : {this->name, this->exec, this->location})
+        pool.release_copy(field);
+    for (std::string_view field : {this->generic_name, this->path, this->id})
+        pool.release(field);
+}
+
+Application::ParseState Application::parse_and_store(
+    char *pos, char *end, const char *location,
+    const LocaleSuffixes &locale_suffixes, const stringlist_t &desktopenvs,
+    std::string &reason, std::string &key_error) {
+    Values values;
+    ParseState state = parse(pos, end, locale_suffixes, desktopenvs, values,
+                             reason, key_error);
+    if (state == ParseState::parsed)
+        store(values.name, values.generic_name, values.exec, values.path,
+              location, {});
+    return state;
+}
+
 bool Application::operator==(const Application &other) const {
     return name == other.name && generic_name == other.generic_name &&
            exec == other.exec && path == other.path &&
@@ -37,24 +210,114 @@ bool Application::operator==(const Application &other) const {
            id == other.id;
 }
 
+Application::ParseResult::ParseResult(ParseState state,
+                                      std::optional<Application> app,
+                                      std::string reason, int error)
+    : state(state), app(std::move(app)), reason(std::move(reason)),
+      error(error) {}
+
+Application::ParseResult
+Application::parse_file(const char *path, LineReader &liner,
+                        const LocaleSuffixes &locale_suffixes,
+                        const stringlist_t &desktopenvs, bool lazy) {
+    size_t length;
+    char *contents = liner.read_file(path, length);
+    if (!contents)
+        return ParseResult(ParseState::unreadable, {}, {}, errno);
+
+    Application app;
+    app.lazy = lazy;
+    std::string reason, key_error;
+    ParseState state =
+        app.parse_and_store(contents, contents + length, path,
+                            locale_suffixes, desktopenvs, reason, key_error);
+    if (state != ParseState::parsed) {
+        ParseResult result(state, {}, std::move(reason));
+        result.key_error = std::move(key_error);
+        return result;
+    }
+    return ParseResult(state, std::move(app));
+}
+
+Application::ParseResult
+Application::parse_buffer(const char *path, std::string &contents,
+                          const LocaleSuffixes &locale_suffixes,
+                          const stringlist_t &desktopenvs, bool lazy) {
+    Application app;
+    app.lazy = lazy;
+    std::string reason, key_error;
+    ParseState state = app.parse_and_store(
+        contents.data(), contents.data() + contents.size(), path,
+        locale_suffixes, desktopenvs, reason, key_error);
+    if (state != ParseState::parsed) {
+        ParseResult result(state, {}, std::move(reason));
+        result.key_error = std::move(key_error);
+        return result;
+    }
+    return ParseResult(state, std::move(app));
+}
+
+void Application::throw_parse_error(const char *path, ParseState state,
+                                    std::string reason,
+                                    const std::string &key_error) {
+    switch (state) {
+    case ParseState::parsed:
+        return;
+    case ParseState::disabled:
+        throw disabled_error(reason);
+    case ParseState::invalid:
+        if (!key_error.empty()) {
+            SPDLOG_ERROR("{}: {}", path, key_error);
+            throw escape_error(reason);
+        }
+        throw invalid_error(reason);
+    case ParseState::unreadable:
+        throw std::system_error(errno, std::system_category());
+    }
+}
+
 Application::Application(const char *path, LineReader &liner,
                          const LocaleSuffixes &locale_suffixes,
                          const stringlist_t &desktopenvs) {
+    size_t length;
+    char *contents = liner.read_file(path, length);
+    if (!contents)
+        throw_parse_error(path, ParseState::unreadable, {}, {});
+
+    std::string reason, key_error;
+    ParseState state =
+        parse_and_store(contents, contents + length, path, locale_suffixes,
+                        desktopenvs, reason, key_error);
+    throw_parse_error(path, state, std::move(reason), key_error);
+}
+
+Application::Application(const char *path, std::string &contents,
+                         const LocaleSuffixes &locale_suffixes,
+                         const stringlist_t &desktopenvs) {
+    std::string reason, key_error;
+    ParseState state = parse_and_store(
+        contents.data(), contents.data() + contents.size(), path,
+        locale_suffixes, desktopenvs, reason, key_error);
+    throw_parse_error(path, state, std::move(reason), key_error);
+}
+
+Application::ParseState
+Application::parse(char *pos, char *end, const LocaleSuffixes &locale_suffixes,
+                   const stringlist_t &desktopenvs, Values &values,
+                   std::string &reason, std::string &key_error) {
     // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
     // !!   The code below is extremely hacky. But fast.    !!
     // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
     //
     // Please don't try this at home.
-
-    this->location = path;
+    //
+    // Lines are split in place. memchr() is used for all scanning, because it
+    // is vectorized in every libc worth using. Nothing past the end of the
+    // [Desktop Entry] group is scanned.
 
     int locale_match = -1, locale_generic_match = -1;
 
     bool parse_key_values = false;
-    ssize_t line_length;
-    std::unique_ptr<FILE, fclose_deleter> file(fopen(path, "r"));
-    if (!file)
-        throw std::system_error(errno, std::system_category());
 
     // The choice of 'unsigned long' is arbitrary here. This variable isn't
     // checked for integer overflow, but it is unlikely that a desktop file will
@@ -62,13 +325,32 @@ Application::Application(const char *path, LineReader &liner,
     // only, so it doesn't matter much.
     unsigned long line_number = 0;
 
-    while ((line_length = liner.getline(file.get())) != -1) {
-        ++line_number;
-        char *line = liner.get_lineptr();
-        line[--line_length] = 0; // Chop off \n
+    key_error.clear();
+    auto invalid = [&reason](std::string message) {
+        reason = std::move(message);
+        return ParseState::invalid;
+    };
+    auto disabled = [&reason](const char *message) {
+        reason = message;
+        return ParseState::disabled;
+    };
 
+    while (pos != end) {
+        char *line = pos;
+        char *line_end = (char *)memchr(pos, '\n', end - pos);
+        if (line_end) {
+            *line_end = '\0';
+            pos = line_end + 1;
+        } else {
+            // The last line isn't terminated by a newline. The buffer is
+            // always NUL terminated, so the line is too.
+            line_end = end;
+            pos = end;
+        }
+
+        ++line_number;
         // Blank line or comment
-        if (!line_length || line[0] == '#')
+        if (line == line_end || line[0] == '#')
             continue;
 
         if (parse_key_values) {
@@ -76,180 +358,237 @@ Application::Application(const char *path, LineReader &liner,
             if (line[0] == '[')
                 break;
 
-            // Split that string in place
-            char *key = line, *value = strpbrk(line, " =");
-            if (!value || value == line)
-                throw invalid_error(
-                    "Malformed file, invalid key=value pair (line " +
-                    std::to_string(line_number) + ").");
-            // Cut spaces before equal sign
-            if (*value != '=') {
-                *value++ = '\0';
-                value = strchr(value, '=');
-                if (!value)
-                    throw invalid_error(
-                        "Malformed file, invalid key=value pair (line " +
-                        std::to_string(line_number) + ").");
-            } else
-                *value = '\0';
+            // Split that string in place. Spaces before the equal sign aren't
+            // part of the key.
+            char *value = (char *)memchr(line, '=', line_end - line);
+            char *key = line, *key_end = value;
+            if (value) {
+                char *space = (char *)memchr(line, ' ', value - line);
+                if (space)
+                    key_end = space;
+            }
+            if (!value || key_end == line)
+                return invalid("Malformed file, invalid key=value pair (line " +
+                               std::to_string(line_number) + ").");
+            *key_end = '\0';
+
+            // Split the locale off localized keys (Name[de]).
+            std::string_view key_name(key, key_end - key), locale;
+            bool localized = false;
+            if (key_name.back() == ']') {
+                auto bracket = key_name.find('[');
+                if (bracket != std::string_view::npos) {
+                    locale = key_name.substr(bracket + 1,
+                                             key_name.size() - bracket - 2);
+                    key_name = key_name.substr(0, bracket);
+                    localized = true;
+                }
+            }
+
+            using DesktopEntryKeys::Key;
+            Key parsed_key = DesktopEntryKeys::lookup(key_name);
+            if (parsed_key == Key::unknown)
+                continue;
+            // Only Name and GenericName are localestrings. Translations of
+            // other keys are ignored.
+            if (localized && parsed_key != Key::name &&
+                parsed_key != Key::generic_name)
+                continue;
+            if (this->lazy &&
+                (parsed_key == Key::exec || parsed_key == Key::path))
+                continue;
+
             value++;
             // Cut spaces after equal sign
             while (*value == ' ')
                 value++;
+            std::string_view value_view(value, line_end - value);
 
-            try {
-                if (strncmp(key, "Name", 4) == 0)
-                    parse_localestring(key, 4, locale_match, value, this->name,
-                                       locale_suffixes);
-                else if (strncmp(key, "GenericName", 11) == 0)
-                    parse_localestring(key, 11, locale_generic_match, value,
-                                       this->generic_name, locale_suffixes);
-                else if (strcmp(key, "Exec") == 0)
-                    this->exec = expand("Exec", value);
-                else if (strcmp(key, "Path") == 0)
-                    this->path = expand("Path", value);
-                else if (strcmp(key, "OnlyShowIn") == 0) {
-                    if (!desktopenvs.empty()) {
-                        stringlist_t values = expandlist("OnlyShowIn", value);
-                        if (!have_equal_element(desktopenvs, values)) {
-                            throw disabled_error(
-                                "Refusing to parse desktop file whose "
-                                "OnlyShowIn field doesn't match current "
-                                "desktop.");
-                        }
-                    }
-                } else if (strcmp(key, "NotShowIn") == 0) {
-                    if (!desktopenvs.empty()) {
-                        stringlist_t values = expandlist("NotShowIn", value);
-                        if (have_equal_element(desktopenvs, values)) {
-                            throw disabled_error(
-                                "Refusing to parse desktop file whose "
-                                "NotShowIn field matches current desktop.");
-                        }
+            std::string error;
+            bool success = true;
+            switch (parsed_key) {
+            case Key::name:
+                success = parse_localestring(key, localized, locale,
+                                             locale_match, value_view,
+                                             values.name, locale_suffixes,
+                                             error);
+                break;
+            case Key::generic_name:
+                success = parse_localestring(
+                    key, localized, locale, locale_generic_match, value_view,
+                    values.generic_name, locale_suffixes, error);
+                break;
+            case Key::exec:
+                success = expand("Exec", value_view, values.exec, error);
+                break;
+            case Key::path:
+                success = expand("Path", value_view, values.path, error);
+                break;
+            case Key::only_show_in:
+                if (!desktopenvs.empty()) {
+                    stringlist_t values;
+                    success =
+                        expandlist("OnlyShowIn", value_view, values, error);
+                    if (success && !have_equal_element(desktopenvs, values)) {
+                        return disabled("Refusing to parse desktop file whose "
+                                        "OnlyShowIn field doesn't match "
+                                        "current desktop.");
                     }
-                } else if (strcmp(key, "Hidden") == 0 ||
-                           strcmp(key, "NoDisplay") == 0) {
-                    if (strcmp(value, "true") == 0) {
-                        throw disabled_error("Refusing to parse Hidden or "
-                                             "NoDisplay desktop file.");
+                }
+                break;
+            case Key::not_show_in:
+                if (!desktopenvs.empty()) {
+                    stringlist_t values;
+                    success =
+                        expandlist("NotShowIn", value_view, values, error);
+                    if (success && have_equal_element(desktopenvs, values)) {
+                        return disabled("Refusing to parse desktop file whose "
+                                        "NotShowIn field matches current "
+                                        "desktop.");
                     }
-                } else if (strcmp(key, "Terminal") == 0) {
-                    this->terminal = strcmp(value, "true") == 0;
                 }
-            } catch (const escape_error &e) {
-                SPDLOG_ERROR("{}: {}", location, e.what());
-                throw escape_error((std::string)e.what() + " (line " +
-                                   std::to_string(line_number) + ")");
+                break;
+            case Key::hidden:
+            case Key::no_display:
+                if (value_view == "true") {
+                    return disabled(
+                        "Refusing to parse Hidden or NoDisplay desktop file.");
+                }
+                break;
+            case Key::terminal:
+                this->terminal = value_view == "true";
+                break;
+            case Key::unknown:
+                break;
+            }
+            if (!success) {
+                key_error = error;
+                return invalid(error + " (line " +
+                               std::to_string(line_number) + ")");
             }
         } else if (!strcmp(line, "[Desktop Entry]"))
             parse_key_values = true;
     }
     if (!parse_key_values)
-        throw invalid_error("Desktop file doesn't contain '[Desktop Entry]'.");
-    if (this->name.empty())
-        throw invalid_error("'Name' key is missing or empty.");
+        return invalid("Desktop file doesn't contain '[Desktop Entry]'.");
+    if (values.name.empty())
+        return invalid("'Name' key is missing or empty.");
+    return ParseState::parsed;
+}
+
+Application::Application(std::string_view name, std::string_view generic_name,
+                         std::string_view exec, std::string_view path,
+                         std::string_view location, bool terminal)
+    : terminal(terminal) {
+    store(name, generic_name, exec, path, location, {});
 }
 
-char Application::convert(char escape) {
+bool Application::convert(char escape, char &result) {
     switch (escape) {
     case 's':
-        return ' ';
+        result = ' ';
+        return true;
     case 'n':
-        return '\n';
+        result = '\n';
+        return true;
     case 't':
-        return '\t';
+        result = '\t';
+        return true;
     case 'r':
-        return '\r';
+        result = '\r';
+        return true;
     case '\\':
-        return '\\';
+        result = '\\';
+        return true;
     }
-    throw escape_error(
-        (std::string) "Tried to interpret invalid escape sequence \\" + escape +
-        ".");
-}
-
-std::string Application::expand(const char *key, const char *value) {
-    size_t len = strlen(value);
-    std::string result;
-    result.reserve(len);
-    bool escape = false; // if true then the next character should be escaped
-    try {
-        for (size_t i = 0; i < len; i++) {
-            if (escape) {
-                result += convert(value[i]);
-                escape = false;
-            } else {
-                if (value[i] == '\\')
-                    escape = true;
-                else
-                    result += value[i];
-            }
+    return false;
+}
+
+static std::string invalid_escape_message(const char *key, char escape) {
+    return (std::string)key +
+           ": Tried to interpret invalid escape sequence \\" + escape + ".";
+}
+
+static std::string trailing_escape_message(const char *key) {
+    return (std::string)key + ": Invalid escape character at end of line.";
+}
+
+bool Application::expand(const char *key, std::string_view value,
+                         std::string &result, std::string &error) {
+    // Unescaped parts of value are copied at once.
+    result.clear();
+    result.reserve(value.size());
+    while (true) {
+        auto backslash = value.find('\\');
+        result.append(value.substr(0, backslash));
+        if (backslash == std::string_view::npos)
+            return true;
+        if (backslash + 1 == value.size()) {
+            error = trailing_escape_message(key);
+            return false;
+        }
+        char converted;
+        if (!convert(value[backslash + 1], converted)) {
+            error = invalid_escape_message(key, value[backslash + 1]);
+            return false;
         }
-        if (escape)
-            throw escape_error("Invalid escape character at end of line.");
-    } catch (const escape_error &e) {
-        throw escape_error((std::string)key + ": " + e.what());
+        result += converted;
+        value.remove_prefix(backslash + 2);
     }
-    return result;
 }
 
-stringlist_t Application::expandlist(const char *key, const char *value) {
-    stringlist_t result;
+bool Application::expandlist(const char *key, std::string_view value,
+                             stringlist_t &result, std::string &error) {
     std::string curr;
-    bool escape = false;
-    try {
-        do {
-            if (escape) {
-                if (*value == ';') // lists also allow ; to be escaped
-                                   // because it has special meaning in
-                    curr += ';';   // lists, so this will handle the escaping
-                                   // of it
-                else
-                    curr += convert(*value);
-                escape = false;
-            } else {
-                switch (*value) {
-                case '\\':
-                    escape = true;
-                    break;
-                case ';':
-                    result.push_back(std::move(curr));
-                    curr.clear();
-                    break;
-                default:
-                    curr += *value;
-                    break;
-                }
-            }
-        } while (*++value != '\0');
-        if (escape)
-            throw escape_error("Invalid escape character at end of line.");
-        if (!curr.empty())
+    while (true) {
+        auto special = value.find_first_of("\\;");
+        curr.append(value.substr(0, special));
+        if (special == std::string_view::npos)
+            break;
+        if (value[special] == ';') {
             result.push_back(std::move(curr));
-    } catch (const escape_error &e) {
-        throw escape_error((std::string)key + ": " + e.what());
+            curr.clear();
+            value.remove_prefix(special + 1);
+            continue;
+        }
+        if (special + 1 == value.size()) {
+            error = trailing_escape_message(key);
+            return false;
+        }
+        // lists also allow ; to be escaped because it has special meaning in
+        // lists, so this will handle the escaping of it
+        char converted = ';';
+        if (value[special + 1] != ';' &&
+            !convert(value[special + 1], converted)) {
+            error = invalid_escape_message(key, value[special + 1]);
+            return false;
+        }
+        curr += converted;
+        value.remove_prefix(special + 2);
     }
-    return result;
+    if (!curr.empty())
+        result.push_back(std::move(curr));
+    return true;
 }
 
-void Application::parse_localestring(const char *key, int key_length,
-                                     int &match, const char *value,
+bool Application::parse_localestring(const char *key, bool localized,
+                                     std::string_view locale, int &match,
+                                     std::string_view value,
                                      std::string &field,
-                                     const LocaleSuffixes &locale_suffixes) {
-    if (key[key_length] == '[') {
-        std::string_view locale(key + key_length + 1,
-                                strlen(key + key_length + 1) - 1);
-
+                                     const LocaleSuffixes &locale_suffixes,
+                                     std::string &error) {
+    if (localized) {
         int new_match = locale_suffixes.match(locale);
         if (new_match == -1)
-            return;
+            return true;
         if (new_match <= match || match == -1) {
             match = new_match;
-            field = expand(key, value);
+            return expand(key, value, field, error);
         }
     } else if (match == -1 || match == 4) {
         match = 4; // The maximum match of LocaleSuffixes.match() is 3. 4
                    // means default value.
-        field = expand(key, value);
+        return expand(key, value, field, error);
     }
+    return true;
 }
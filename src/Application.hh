@@ -18,10 +18,14 @@
 #ifndef APPLICATION_DEF
 #define APPLICATION_DEF
 
+#include <memory>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 
 #include "LocaleSuffixes.hh"
+#include "StringPool.hh"
 #include "Utilities.hh"
 
 class LineReader;
@@ -47,20 +51,33 @@ struct escape_error final : public invalid_error
 class Application
 {
 public:
+    // Possible outcomes of parsing a desktop file.
+    enum class ParseState : unsigned char {
+        parsed,
+        disabled,
+        invalid,
+        unreadable
+    };
+    struct ParseResult;
+
+    // All strings are NUL terminated. They are stored in a single buffer
+    // shared by all copies of the Application or in a StringPool (see
+    // intern()).
+
     // Localized name
-    std::string name;
+    std::string_view name;
 
     // Generic name
-    std::string generic_name;
+    std::string_view generic_name;
 
     // Command line
-    std::string exec;
+    std::string_view exec;
 
     // CWD of program
-    std::string path;
+    std::string_view path;
 
     // Path of .desktop file
-    std::string location;
+    std::string_view location;
 
     // Terminal app
     bool terminal = false;
@@ -68,25 +85,137 @@ public:
     // file id
     // It isn't set by Application, it is a helper variable managed by
     // Applications
-    std::string id;
+    std::string_view id;
 
     bool operator==(const Application &other) const;
 
+    // Construct an empty Application (AppManager uses this for unused slots).
+    Application() = default;
+    // Copies of an interned Application own their strings.
+    Application(const Application &other);
+    Application(Application &&) = default;
+    Application &operator=(const Application &other);
+    Application &operator=(Application &&) = default;
+
     // If desktopenvs is {}, notShowIn and onlyShowIn will be ignored.
     Application(const char *path, LineReader &liner,
                 const LocaleSuffixes &locale_suffixes,
                 const stringlist_t &desktopenvs);
 
+    // Parse a desktop file which has already been read to memory. contents
+    // is modified during parsing.
+    Application(const char *path, std::string &contents,
+                const LocaleSuffixes &locale_suffixes,
+                const stringlist_t &desktopenvs);
+
+    // Construct an Application from values which have already been parsed
+    // (this is used by AppCache).
+    Application(std::string_view name, std::string_view generic_name,
+                std::string_view exec, std::string_view path,
+                std::string_view location, bool terminal);
+
+    // These are the exception-free counterparts of the ctors above. Disabled
+    // desktop files are very common, throwing disabled_error for each one of
+    // them is expensive.
+    // If lazy is true, Exec and Path aren't parsed, exec and path are left
+    // empty. They are needed only to execute the desktop file, so the desktop
+    // file is parsed again (with lazy == false) once it has been selected.
+    static ParseResult parse_file(const char *path, LineReader &liner,
+                                  const LocaleSuffixes &locale_suffixes,
+                                  const stringlist_t &desktopenvs,
+                                  bool lazy = false);
+    static ParseResult parse_buffer(const char *path, std::string &contents,
+                                    const LocaleSuffixes &locale_suffixes,
+                                    const stringlist_t &desktopenvs,
+                                    bool lazy = false);
+
+    // Return true if Exec and Path haven't been parsed.
+    bool has_lazy_values() const;
+
+    // Move all strings to pool. Strings which are often shared by multiple
+    // desktop files (GenericName, Path) are interned. The strings must be
+    // released with release_strings() once the Application is no longer
+    // needed, otherwise they will be kept in the pool. This mustn't be called
+    // twice with the same pool.
+    void intern(StringPool &pool);
+    void release_strings(StringPool &pool) const;
+
 private:
-    static char convert(char escape);
-    std::string expand(const char *key, const char *value);
-    stringlist_t expandlist(const char *key, const char *value);
+    bool lazy = false;
+    // This is empty if the strings have been interned.
+    std::shared_ptr<char[]> storage;
+
+    // Strings of an Application which is being parsed.
+    struct Values
+    {
+        std::string name;
+        std::string generic_name;
+        std::string exec;
+        std::string path;
+    };
+
+    // Copy all strings to a newly allocated storage.
+    void store(std::string_view name, std::string_view generic_name,
+               std::string_view exec, std::string_view path,
+               std::string_view location, std::string_view id);
+    // Parse the desktop file and store the result.
+    ParseState parse_and_store(char *pos, char *end, const char *location,
+                               const LocaleSuffixes &locale_suffixes,
+                               const stringlist_t &desktopenvs,
+                               std::string &reason, std::string &key_error);
+
+    // Throw the exception corresponding to state (unless it's parsed).
+    // Exception of an unreadable file is created from errno. key_error is
+    // logged before escape_error is thrown.
+    static void throw_parse_error(const char *path, ParseState state,
+                                  std::string reason,
+                                  const std::string &key_error);
+
+    // Parse the [Desktop Entry] group of a desktop file stored in [pos, end).
+    // The buffer must be NUL terminated (*end == '\0'), it is modified during
+    // parsing. If the desktop file is disabled or invalid, reason is set.
+    // key_error is set to the error of the offending key if it is invalid
+    // because of an invalid escape sequence. Nothing is logged here, desktop
+    // files may be parsed on worker threads.
+    ParseState parse(char *pos, char *end,
+                     const LocaleSuffixes &locale_suffixes,
+                     const stringlist_t &desktopenvs, Values &values,
+                     std::string &reason, std::string &key_error);
+
+    // These functions return false and set error on invalid escape sequences.
+    static bool convert(char escape, char &result);
+    static bool expand(const char *key, std::string_view value,
+                       std::string &result, std::string &error);
+    static bool expandlist(const char *key, std::string_view value,
+                           stringlist_t &result, std::string &error);
 
     // Value is assigned to field if the new match is less or equal the current
-    // match. Newer entries of same match override older ones.
-    void parse_localestring(const char *key, int key_length, int &match,
-                            const char *value, std::string &field,
-                            const LocaleSuffixes &locale_suffixes);
+    // match. Newer entries of same match override older ones. key is the whole
+    // key (including the locale) used for error messages. locale is used only
+    // if localized is true.
+    static bool parse_localestring(const char *key, bool localized,
+                                   std::string_view locale, int &match,
+                                   std::string_view value, std::string &field,
+                                   const LocaleSuffixes &locale_suffixes,
+                                   std::string &error);
+};
+
+struct Application::ParseResult
+{
+    ParseState state;
+    // This is populated only when state == ParseState::parsed.
+    std::optional<Application> app;
+    // This is the reason why the desktop file is disabled or invalid.
+    std::string reason;
+    // This is the errno of the failed read when state ==
+    // ParseState::unreadable.
+    int error;
+    // This is the error of the offending key when the desktop file is invalid
+    // because of an invalid escape sequence. The caller should log it.
+    std::string key_error;
+
+    ParseResult(ParseState state, std::optional<Application> app,
+                std::string reason = {}, int error = 0);
 };
 
 #endif
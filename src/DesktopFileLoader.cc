@@ -0,0 +1,54 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "DesktopFileLoader.hh"
+
+#include <spdlog/spdlog.h>
+
+#include <errno.h>
+
+#include "Utilities.hh"
+
+#ifdef USE_IO_URING
+#include "IoUringLoader.hh"
+#endif
+
+std::unique_ptr<DesktopFileLoader> DesktopFileLoader::create() {
+#ifdef USE_IO_URING
+    std::unique_ptr<DesktopFileLoader> io_uring_loader =
+        IoUringDesktopFileLoader::create();
+    if (io_uring_loader)
+        return io_uring_loader;
+    SPDLOG_INFO("io_uring isn't available, reading desktop files "
+                "synchronously.");
+#endif
+    return std::make_unique<SyncDesktopFileLoader>();
+}
+
+std::vector<LoadedFile>
+SyncDesktopFileLoader::load(const std::vector<const char *> &paths) {
+    std::vector<LoadedFile> result(paths.size());
+    for (std::vector<const char *>::size_type i = 0; i < paths.size(); ++i) {
+        if (!read_file(paths[i], result[i].contents))
+            result[i].error = errno;
+    }
+    return result;
+}
+
+const char *SyncDesktopFileLoader::name() const {
+    return "sync";
+}
@@ -0,0 +1,65 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef DESKTOPFILELOADER_DEF
+#define DESKTOPFILELOADER_DEF
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// A desktop file read to memory.
+struct LoadedFile
+{
+    std::string contents;
+    // errno value of the failed operation or 0 if the file has been read
+    // successfully.
+    int error = 0;
+};
+
+// DesktopFileLoader reads whole desktop files. AppManager reads all desktop
+// files of a rank at once through it and passes the buffers to Application's
+// ctor.
+class DesktopFileLoader
+{
+public:
+    // Read paths. The result has the same order as paths. Errors are reported
+    // through LoadedFile::error.
+    virtual std::vector<LoadedFile>
+    load(const std::vector<const char *> &paths) = 0;
+
+    virtual const char *name() const = 0;
+
+    virtual ~DesktopFileLoader() {}
+
+    // Return the io_uring loader if j4-dmenu-desktop has been compiled with
+    // io_uring support and the kernel supports it. Return the synchronous
+    // loader otherwise.
+    static std::unique_ptr<DesktopFileLoader> create();
+};
+
+// This loader reads files one by one with plain read().
+class SyncDesktopFileLoader final : public DesktopFileLoader
+{
+public:
+    std::vector<LoadedFile>
+    load(const std::vector<const char *> &paths) override;
+
+    const char *name() const override;
+};
+
+#endif
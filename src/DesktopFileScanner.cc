@@ -0,0 +1,104 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "DesktopFileScanner.hh"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace DesktopFileScanner
+{
+struct RankResult
+{
+    int rank;
+    const Scanned_directory_callback *on_directory;
+    std::mutex mutex;
+    std::vector<std::string> files;
+};
+
+// Read a single directory. Subdirectories are submitted to pool. They are
+// opened relative to this directory (see FileFinder::open_directory()).
+static void scan_directory(FileFinder::directory_handle parent,
+                           std::string dirpath,
+                           std::string::size_type name_offset,
+                           RankResult &result, ThreadPool &pool) {
+    FileFinder::directory_handle dir =
+        FileFinder::open_directory(parent, dirpath, name_offset);
+    parent.reset();
+    if (*result.on_directory)
+        (*result.on_directory)(result.rank, dirpath);
+
+    std::vector<std::string> found;
+    std::string path = dirpath;
+    dirent *entry;
+    while ((entry = readdir(dir.get()))) {
+        if (entry->d_name[0] == '.') {
+            // Exclude ., .. and hidden files
+            continue;
+        }
+        path.resize(dirpath.size());
+        path += entry->d_name;
+        if (FileFinder::is_directory_entry(dir.get(), entry)) {
+            pool.submit([dir, subdir = path + "/", offset = dirpath.size(),
+                         &result, &pool]() {
+                scan_directory(dir, std::move(subdir), offset, result, pool);
+            });
+        } else if (endswith(entry->d_name, ".desktop"))
+            found.push_back(path);
+    }
+
+    if (!found.empty()) {
+        std::lock_guard lock(result.mutex);
+        result.files.insert(result.files.end(),
+                            std::make_move_iterator(found.begin()),
+                            std::make_move_iterator(found.end()));
+    }
+}
+}; // namespace DesktopFileScanner
+
+Desktop_file_list
+scan_desktop_files(const stringlist_t &search_path, ThreadPool &pool,
+                   const Scanned_directory_callback &on_directory) {
+    using namespace DesktopFileScanner;
+
+    std::vector<RankResult> results(search_path.size());
+    for (stringlist_t::size_type i = 0; i < search_path.size(); ++i) {
+        results[i].rank = i;
+        results[i].on_directory = &on_directory;
+        pool.submit([&base_path = search_path[i], &result = results[i],
+                     &pool]() {
+            scan_directory(nullptr, base_path, 0, result, pool);
+        });
+    }
+    pool.wait();
+
+    Desktop_file_list list;
+    list.reserve(search_path.size());
+    for (stringlist_t::size_type i = 0; i < search_path.size(); ++i) {
+        std::vector<std::string> &files = results[i].files;
+        std::sort(files.begin(), files.end());
+        SPDLOG_DEBUG("DesktopFileScanner: Found {} desktop files in '{}'.",
+                     files.size(), search_path[i]);
+        list.emplace_back(search_path[i], std::move(files));
+    }
+    return list;
+}
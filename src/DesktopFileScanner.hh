@@ -0,0 +1,50 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef DESKTOPFILESCANNER_DEF
+#define DESKTOPFILESCANNER_DEF
+
+#include <functional>
+#include <string>
+
+#include "AppManager.hh"
+#include "FileFinder.hh"
+#include "ThreadPool.hh"
+#include "Utilities.hh"
+
+// Called with the rank and the path (ending with '/') of a directory found by
+// scan_desktop_files().
+using Scanned_directory_callback =
+    std::function<void(int rank, const std::string &path)>;
+
+// Find all desktop files in search path. This is the parallel counterpart of
+// walking each search path directory with FileFinder.
+//
+// Every directory (including subdirectories) is read in a separate ThreadPool
+// task, so ranks and their subdirectories are scanned concurrently. Files in
+// each rank are sorted by their path, so the result doesn't depend on
+// scheduling. Hidden files and directories are skipped like in FileFinder.
+//
+// If on_directory is set, it is called for every directory after it has been
+// opened and before it is read. It is called from several threads at once.
+//
+// This throws std::runtime_error if a directory can't be opened.
+Desktop_file_list
+scan_desktop_files(const stringlist_t &search_path, ThreadPool &pool,
+                   const Scanned_directory_callback &on_directory = {});
+
+#endif
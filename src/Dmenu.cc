@@ -18,25 +18,107 @@
 #include "Dmenu.hh"
 
 #include <spdlog/spdlog.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <spawn.h>
 #include <stdexcept>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <utility>
 
-#include "Utilities.hh"
+extern char **environ;
 
 Dmenu::Dmenu(std::string dmenu_command, const char *sh)
     : dmenu_command(std::move(dmenu_command)), shell(sh) {}
 
+#ifdef IOV_MAX
+static constexpr size_t max_iovecs = IOV_MAX;
+#else
+static constexpr size_t max_iovecs = 1024;
+#endif
+
+static char newline = '\n';
+
 void Dmenu::write(std::string_view what) {
-    writen(this->outpipe[1], what.data(), what.size());
-    writen(this->outpipe[1], "\n", 1);
+    if (this->pending.size() + 2 > max_iovecs)
+        flush();
+    this->pending.push_back({const_cast<char *>(what.data()), what.size()});
+    this->pending.push_back({&newline, 1});
+}
+
+void Dmenu::flush() {
+    write_iovecs(this->pending.data(), this->pending.size());
+    this->pending.clear();
+}
+
+void Dmenu::write_payload(std::string_view payload) {
+    flush();
+    iovec iov = {const_cast<char *>(payload.data()), payload.size()};
+    write_iovecs(&iov, 1);
+}
+
+void Dmenu::splice_payload(std::string_view payload) {
+    flush();
+    iovec iov = {const_cast<char *>(payload.data()), payload.size()};
+#ifdef SPLICE_F_GIFT
+    while (iov.iov_len > 0) {
+        ssize_t spliced = vmsplice(this->outpipe[1], &iov, 1, 0);
+        ++this->write_calls;
+        if (spliced == -1) {
+            if (errno == EINTR)
+                continue;
+            SPDLOG_DEBUG("Dmenu: vmsplice() failed, falling back to "
+                         "writev(): {}",
+                         strerror(errno));
+            break;
+        }
+        this->written_bytes += spliced;
+        iov.iov_base = static_cast<char *>(iov.iov_base) + spliced;
+        iov.iov_len -= spliced;
+    }
+#endif
+    if (iov.iov_len > 0)
+        write_iovecs(&iov, 1);
+}
+
+// Write everything, iov is modified when a write is partial. Errors are
+// ignored, they are caused by dmenu exiting prematurely which is handled
+// elsewhere.
+void Dmenu::write_iovecs(iovec *iov, size_t count) {
+    while (count > 0) {
+        ssize_t written = writev(this->outpipe[1], iov, count);
+        ++this->write_calls;
+        if (written == -1) {
+            if (errno == EINTR)
+                continue;
+            SPDLOG_DEBUG("Dmenu: writev() failed: {}", strerror(errno));
+            return;
+        }
+        this->written_bytes += written;
+        // Skip the iovecs which have been written completely.
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<char *>(iov->iov_base) + written;
+            iov->iov_len -= written;
+        }
+    }
 }
 
 void Dmenu::display() {
+    flush();
+    SPDLOG_DEBUG("Dmenu: Wrote {} bytes in {} system calls.",
+                 this->written_bytes, this->write_calls);
     SPDLOG_DEBUG("Dmenu: Displaying Dmenu.");
     // Closing the pipe produces EOF for dmenu, signalling
     // end of all options. dmenu shows now up on the screen
@@ -44,7 +126,30 @@ void Dmenu::display() {
     close(this->outpipe[1]);
 }
 
-std::string Dmenu::read_choice() {
+int Dmenu::output_fd() const {
+    return this->inpipe[0];
+}
+
+bool Dmenu::read_output() {
+    char buf[4096];
+    ssize_t len = read(this->inpipe[0], buf, sizeof buf);
+    if (len > 0) {
+        this->output.append(buf, len);
+        return false;
+    }
+    if (len == -1) {
+        if (errno == EINTR || errno == EAGAIN)
+            return false;
+        perror("read");
+    }
+    return true;
+}
+
+std::vector<std::string> Dmenu::finish() {
+    close(this->inpipe[0]);
+    std::string output = std::move(this->output);
+    this->output.clear();
+
     int status;
     waitpid(this->pid, &status, 0);
 
@@ -52,7 +157,6 @@ std::string Dmenu::read_choice() {
     // false handler will be executed because j4dd would receive SIGPIPE or
     // block when trying to call Dmenu::write().
     if (!WIFEXITED(status)) {
-        close(inpipe[0]);
         SPDLOG_ERROR("Dmenu exited abnormally!");
         exit(EXIT_FAILURE);
     }
@@ -63,21 +167,27 @@ std::string Dmenu::read_choice() {
             SPDLOG_INFO("Dmenu has exited with unexpected exit status {}.",
                         WEXITSTATUS(status));
         }
-        close(inpipe[0]);
         return {};
     }
 
-    std::string choice;
-    char buf[256];
-    ssize_t len;
-    while ((len = read(inpipe[0], buf, sizeof buf)) > 0)
-        choice.append(buf, len);
-    if (len == -1)
-        perror("read");
-    if (!choice.empty() && choice.back() == '\n')
-        choice.pop_back();
-    close(inpipe[0]);
-    return choice;
+    std::vector<std::string> choices;
+    std::string_view rest = output;
+    while (!rest.empty()) {
+        auto end = rest.find('\n');
+        std::string_view line = rest.substr(0, end);
+        if (!line.empty())
+            choices.emplace_back(line);
+        if (end == std::string_view::npos)
+            break;
+        rest.remove_prefix(end + 1);
+    }
+    return choices;
+}
+
+std::vector<std::string> Dmenu::read_choice() {
+    while (!read_output())
+        ;
+    return finish();
 }
 
 void Dmenu::run() {
@@ -90,27 +200,54 @@ void Dmenu::run() {
     if (pipe(this->inpipe.data()) == -1 || pipe(this->outpipe.data()) == -1)
         throw std::runtime_error("Dmenu::create(): pipe() failed");
 
-    this->pid = fork();
-    switch (this->pid) {
-    case -1:
-        throw std::runtime_error("Dmenu::create(): fork() failed");
-    case 0:
-        close(this->inpipe[0]);
-        close(this->outpipe[1]);
-
-        dup2(this->inpipe[1], STDOUT_FILENO);
-        dup2(this->outpipe[0], STDIN_FILENO);
-
-        close(this->inpipe[1]);
-        close(this->outpipe[0]);
-
-        execl(
-            shell, shell, "-c", this->dmenu_command.c_str(), 0,
-            nullptr); // double nulls are needed because of
-                      // https://github.com/enkore/j4-dmenu-desktop/pull/66#issuecomment-273126739
-        SPDLOG_ERROR("Couldn't execute dmenu!");
-        _exit(EXIT_FAILURE);
-    }
+#ifdef F_SETPIPE_SZ
+    // This can fail if the size exceeds /proc/sys/fs/pipe-max-size or if the
+    // user has too many large pipes. The default size is kept then.
+    if (fcntl(this->outpipe[1], F_SETPIPE_SZ, pipe_size) == -1)
+        SPDLOG_DEBUG("Dmenu: Couldn't resize pipe to {} bytes: {}", pipe_size,
+                     strerror(errno));
+#endif
+    this->written_bytes = 0;
+    this->write_calls = 0;
+
+    // posix_spawn() doesn't copy the page tables of j4-dmenu-desktop, which
+    // can be large in wait-on mode.
+    auto fail = [this](int error) {
+        for (int fd : {inpipe[0], inpipe[1], outpipe[0], outpipe[1]})
+            close(fd);
+        throw std::runtime_error(
+            (std::string) "Dmenu::run(): Couldn't execute dmenu: " +
+            strerror(error));
+    };
+
+    posix_spawn_file_actions_t actions;
+    int error = posix_spawn_file_actions_init(&actions);
+    if (error != 0)
+        fail(error);
+    // dmenu mustn't be started if any of the redirections is missing.
+    error = posix_spawn_file_actions_addclose(&actions, this->inpipe[0]);
+    if (error == 0)
+        error = posix_spawn_file_actions_addclose(&actions, this->outpipe[1]);
+    if (error == 0)
+        error = posix_spawn_file_actions_adddup2(&actions, this->inpipe[1],
+                                                 STDOUT_FILENO);
+    if (error == 0)
+        error = posix_spawn_file_actions_adddup2(&actions, this->outpipe[0],
+                                                 STDIN_FILENO);
+    if (error == 0)
+        error = posix_spawn_file_actions_addclose(&actions, this->inpipe[1]);
+    if (error == 0)
+        error = posix_spawn_file_actions_addclose(&actions, this->outpipe[0]);
+
+    const char *argv[] = {shell, "-c", this->dmenu_command.c_str(), nullptr};
+    pid_t child;
+    if (error == 0)
+        error = posix_spawn(&child, shell, &actions, nullptr,
+                            const_cast<char *const *>(argv), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (error != 0)
+        fail(error);
+    this->pid = child;
 
     close(this->inpipe[1]);
     close(this->outpipe[0]);
@@ -19,9 +19,12 @@
 #define DMENU_DEF
 
 #include <array>
+#include <stddef.h>
 #include <string>
 #include <string_view>
+#include <sys/uio.h>
 #include <type_traits>
+#include <vector>
 
 class Dmenu
 {
@@ -35,10 +38,37 @@ public:
     Dmenu &operator=(Dmenu &&) = default;
 
     // The caller may wish to handle SIGPIPE to detect dmenu failure when
-    // calling write().
+    // calling write(), flush(), write_payload(), splice_payload() and
+    // display().
+
+    // Queue a name to be written to dmenu. Queued names are written together
+    // with writev() once enough of them have been queued or when flush() or
+    // display() is called. what isn't copied, it must be valid until then.
     void write(std::string_view what);
+    void flush();
+    // Write names which are already separated (and terminated) by newlines.
+    void write_payload(std::string_view payload);
+    // Like write_payload(), but the pages of payload are moved to the pipe
+    // with vmsplice() instead of being copied when it's supported. payload
+    // should be page aligned (see PageBuffer) and it mustn't be modified or
+    // freed until finish() returns.
+    void splice_payload(std::string_view payload);
     void display();
-    std::string read_choice();
+
+    // Output of dmenu is read as it arrives, so dmenu never blocks on a full
+    // pipe (this can happen when a lot of entries are selected in launchers
+    // supporting multiple selection). read_output() reads what's available
+    // and returns true at EOF. finish() must be called then. It waits for
+    // dmenu to exit and returns the selected lines (no lines are returned if
+    // nothing has been selected).
+    //
+    // In wait-on mode, read_output() is called whenever output_fd() is
+    // readable. read_choice() does everything in one call.
+    int output_fd() const;
+    bool read_output();
+    std::vector<std::string> finish();
+    std::vector<std::string> read_choice();
+
     void run();
 
 private:
@@ -48,6 +78,21 @@ private:
     std::array<int, 2> inpipe;
     std::array<int, 2> outpipe;
     int pid = 0;
+
+    // Size of the pipe to dmenu requested in run(). Menus usually fit into it
+    // whole, so writing them doesn't block until dmenu reads them.
+    static constexpr int pipe_size = 1024 * 1024;
+
+    // Output read by read_output().
+    std::string output;
+
+    // Names and newlines queued by write().
+    std::vector<iovec> pending;
+    // These are logged by display().
+    size_t written_bytes = 0;
+    size_t write_calls = 0;
+
+    void write_iovecs(iovec *iov, size_t count);
 };
 
 static_assert(std::is_move_constructible_v<Dmenu>);
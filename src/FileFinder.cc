@@ -19,13 +19,17 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <fcntl.h>
 #include <stdexcept>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
+#include <utility>
 
 #include "Utilities.hh"
 
-FileFinder::FileFinder(const std::string &path) : done(false), dir(NULL) {
-    dirstack.push(path);
+FileFinder::FileFinder(const std::string &path) : done(false), curdirlen(0) {
+    dirstack.push({nullptr, path, 0});
 }
 
 FileFinder::operator bool() const {
@@ -42,49 +46,87 @@ bool FileFinder::isdir() const {
 
 FileFinder &FileFinder::operator++() {
     if (direntries.empty()) {
-        dirent *entry;
         opendir();
         if (done)
             return *this;
-        while ((entry = readdir(dir))) {
-            if (entry->d_name[0] == '.') {
-                // Exclude ., .. and hidden files
-                continue;
-            }
-            direntries.emplace_back(entry);
-        }
-        closedir(dir);
-        dir = NULL;
-        std::sort(direntries.begin(), direntries.end(),
-                  [](const _dirent &a, const _dirent &b) {
-                      return a.d_ino > b.d_ino;
-                  });
         return ++(*this);
 
     } else {
-        curpath = curdir + direntries.back().d_name;
-        curisdir = is_directory(curpath);
+        const _dirent &entry = direntries.back();
+        curpath.resize(curdirlen);
+        curpath += names.c_str() + entry.name_offset;
+        curisdir = entry.isdir;
         direntries.pop_back();
         if (curisdir) {
-            dirstack.push(curpath + "/");
+            dirstack.push({curdirhandle, curpath + "/", curdirlen});
         }
         return *this;
     }
 }
 
-FileFinder::_dirent::_dirent(const dirent *ent)
-    : d_ino(ent->d_ino), d_name(ent->d_name) {}
+FileFinder::directory_handle
+FileFinder::open_directory(const directory_handle &parent,
+                           const std::string &path,
+                           std::string::size_type name_offset) {
+    int fd;
+    if (parent)
+        fd = openat(dirfd(parent.get()), path.c_str() + name_offset,
+                    O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    else
+        fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+        throw std::runtime_error(path + ": opendir() failed");
+    DIR *dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        throw std::runtime_error(path + ": opendir() failed");
+    }
+    return directory_handle(dir, closedir);
+}
+
+bool FileFinder::is_directory_entry(DIR *dir, const dirent *entry) {
+    if (entry->d_type == DT_DIR)
+        return true;
+    // Symlinks must be followed.
+    if (entry->d_type != DT_UNKNOWN && entry->d_type != DT_LNK)
+        return false;
+    struct stat st;
+    if (fstatat(dirfd(dir), entry->d_name, &st, 0) == -1)
+        return false;
+    return S_ISDIR(st.st_mode);
+}
 
 void FileFinder::opendir() {
     if (dirstack.empty()) {
+        curdirhandle.reset();
         done = true;
         return;
     }
 
-    curdir = dirstack.top();
+    pending_directory pending = std::move(dirstack.top());
     dirstack.pop();
-    dir = ::opendir(curdir.c_str());
-    if (!dir)
-        throw std::runtime_error(curdir + ": opendir() failed");
+    curdirhandle =
+        open_directory(pending.parent, pending.path, pending.name_offset);
+    pending.parent.reset();
+    curpath = std::move(pending.path);
+    curdirlen = curpath.size();
+
     direntries.clear();
+    names.clear();
+    DIR *dir = curdirhandle.get();
+    dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (entry->d_name[0] == '.') {
+            // Exclude ., .. and hidden files
+            continue;
+        }
+        direntries.push_back(
+            {entry->d_ino, is_directory_entry(dir, entry), names.size()});
+        names += entry->d_name;
+        names += '\0';
+    }
+    std::sort(direntries.begin(), direntries.end(),
+              [](const _dirent &a, const _dirent &b) {
+                  return a.d_ino > b.d_ino;
+              });
 }
@@ -20,45 +20,79 @@
 
 #include <dirent.h>
 #include <iterator>
+#include <memory>
 #include <stack>
 #include <string>
 #include <sys/types.h>
 #include <vector>
 
+// FileFinder recursively walks a directory. Hidden files and directories are
+// skipped.
+//
+// Subdirectories are opened relative to their parent directory with openat()
+// and file types are determined from d_type. stat() is called only when
+// d_type isn't known or when the entry is a symlink (symlinks to directories
+// are followed).
 class FileFinder
 {
 public:
     typedef std::input_iterator_tag iterator_category;
 
+    // An open directory. Subdirectories which haven't been opened yet keep a
+    // reference to their parent.
+    using directory_handle = std::shared_ptr<DIR>;
+
     FileFinder(const std::string &path);
     operator bool() const;
+    // This returns path (given in ctor) / filename. If path is absolute,
+    // returned path will be absolute. The returned reference points to a
+    // buffer which is reused by operator++.
     const std::string &path() const;
     bool isdir() const;
 
-    // This returns path (given in ctor) / filename. If path is absolute,
-    // returned path will be absolute.
     FileFinder &operator++();
 
+    // These are building blocks of FileFinder, they are used by other
+    // directory walkers too.
+
+    // Open directory path. If parent is set, the last path component of path
+    // (beginning at name_offset) is opened relative to it. This throws
+    // std::runtime_error on failure.
+    static directory_handle open_directory(const directory_handle &parent,
+                                           const std::string &path,
+                                           std::string::size_type name_offset);
+    // Return true if entry read from dir is a directory.
+    static bool is_directory_entry(DIR *dir, const dirent *entry);
+
 private:
     struct _dirent
     {
-        _dirent(const dirent *ent);
-
         ino_t d_ino;
-        std::string d_name;
+        bool isdir;
+        // Offset of the name in FileFinder::names.
+        std::string::size_type name_offset;
+    };
+
+    struct pending_directory
+    {
+        directory_handle parent;
+        std::string path;
+        std::string::size_type name_offset;
     };
 
     void opendir();
 
     bool done;
 
-    DIR *dir;
-    std::stack<std::string> dirstack;
+    std::stack<pending_directory> dirstack;
     std::vector<_dirent> direntries;
+    // Names of direntries separated by '\0'.
+    std::string names;
 
+    directory_handle curdirhandle;
     std::string curpath;
     bool curisdir;
-    std::string curdir;
+    std::string::size_type curdirlen;
 };
 
 #endif
@@ -0,0 +1,606 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef FLATHASHMAP_DEF
+#define FLATHASHMAP_DEF
+
+// FlatHashMap and FlatHashSet are open addressing hash tables which store
+// their elements in a single array instead of allocating a node for each one
+// of them like std::unordered_map does.
+//
+// They use the scheme of SwissTable (Abseil's flat_hash_map). Every slot has a
+// control byte which says whether the slot is empty, deleted or full. Control
+// bytes of full slots contain 7 bits of the hash of their element. Lookup
+// compares the control bytes of a whole group of slots at once (using SSE2 if
+// it is available) and it compares keys only when their hashes match.
+//
+// Lookup, insertion and removal are heterogeneous: strings can be looked up by
+// std::string_view, std::string or const char * regardless of the type of the
+// key, no temporary std::string is constructed.
+//
+// Only the subset of the std::unordered_map interface which is used by j4dd is
+// implemented. Unlike std::unordered_map, insertion invalidates all iterators,
+// pointers and references to elements if the table grows. Removal invalidates
+// only the iterators, pointers and references to the removed element. Keys
+// and values must be nothrow move constructible.
+
+#include <functional>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace FlatHash
+{
+// Default hash of FlatHashMap and FlatHashSet. All strings are hashed as
+// string_views to make heterogeneous lookup possible.
+struct Hash
+{
+    using is_transparent = void;
+
+    size_t operator()(std::string_view str) const {
+        return std::hash<std::string_view>()(str);
+    }
+
+    template <typename T,
+              std::enable_if_t<std::is_integral_v<T> || std::is_enum_v<T>,
+                               int> = 0>
+    size_t operator()(T value) const {
+        return std::hash<T>()(value);
+    }
+};
+
+enum Control : int8_t { empty = -128, deleted = -2 };
+
+// Some std::hash specializations (including the one for integers in
+// libstdc++) don't distribute their bits well. Mix them, the lowest 7 bits
+// are stored in control bytes and the rest determines the position.
+inline uint64_t mix_hash(size_t hash) {
+    uint64_t result = (uint64_t)hash * 0x9E3779B97F4A7C15ull;
+    return result ^ (result >> 32);
+}
+
+// Bitmask of slots in a group. Bit i represents i-th slot of the group.
+class BitMask
+{
+public:
+    explicit BitMask(uint32_t mask) : mask(mask) {}
+
+    explicit operator bool() const {
+        return this->mask != 0;
+    }
+
+    unsigned int lowest() const {
+        return __builtin_ctz(this->mask);
+    }
+
+    void remove_lowest() {
+        this->mask &= this->mask - 1;
+    }
+
+private:
+    uint32_t mask;
+};
+
+#ifdef __SSE2__
+class Group
+{
+public:
+    static constexpr size_t width = 16;
+
+    explicit Group(const int8_t *ctrl)
+        : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl))) {}
+
+    BitMask match(int8_t h2) const {
+        return BitMask(_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_set1_epi8(h2), this->ctrl)));
+    }
+
+    BitMask match_empty() const {
+        return match(Control::empty);
+    }
+
+    // Both special control bytes are lower than -1.
+    BitMask match_empty_or_deleted() const {
+        return BitMask(_mm_movemask_epi8(
+            _mm_cmpgt_epi8(_mm_set1_epi8(-1), this->ctrl)));
+    }
+
+private:
+    __m128i ctrl;
+};
+#else
+class Group
+{
+public:
+    static constexpr size_t width = 8;
+
+    explicit Group(const int8_t *ctrl) {
+        memcpy(this->ctrl, ctrl, width);
+    }
+
+    BitMask match(int8_t h2) const {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < width; ++i)
+            if (this->ctrl[i] == h2)
+                mask |= 1u << i;
+        return BitMask(mask);
+    }
+
+    BitMask match_empty() const {
+        return match(Control::empty);
+    }
+
+    BitMask match_empty_or_deleted() const {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < width; ++i)
+            if (this->ctrl[i] < -1)
+                mask |= 1u << i;
+        return BitMask(mask);
+    }
+
+private:
+    int8_t ctrl[width];
+};
+#endif
+
+// Shared implementation of FlatHashMap and FlatHashSet. KeyOf extracts the key
+// from Value.
+template <typename Key, typename Value, typename KeyOf, typename HashFn,
+          typename KeyEqual>
+class Table
+{
+public:
+    using key_type = Key;
+    using value_type = Value;
+    using size_type = size_t;
+
+    template <bool Const> class Iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Table::value_type;
+        using difference_type = ptrdiff_t;
+        using reference = std::conditional_t<Const, const Value &, Value &>;
+        using pointer = std::conditional_t<Const, const Value *, Value *>;
+
+        Iterator() = default;
+
+        // Allow conversion of iterator to const_iterator.
+        template <bool C = Const, std::enable_if_t<C, int> = 0>
+        Iterator(const Iterator<false> &other)
+            : table(other.table), index(other.index) {}
+
+        reference operator*() const {
+            return this->table->slots[this->index];
+        }
+
+        pointer operator->() const {
+            return &this->table->slots[this->index];
+        }
+
+        Iterator &operator++() {
+            this->index = this->table->next_full(this->index + 1);
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        bool operator==(const Iterator &other) const {
+            return this->index == other.index;
+        }
+
+        bool operator!=(const Iterator &other) const {
+            return this->index != other.index;
+        }
+
+    private:
+        using table_pointer = std::conditional_t<Const, const Table *, Table *>;
+
+        Iterator(table_pointer table, size_t index)
+            : table(table), index(index) {}
+
+        table_pointer table = nullptr;
+        size_t index = 0;
+
+        friend class Table;
+        friend class Iterator<!Const>;
+    };
+
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    Table() = default;
+
+    Table(const Table &other) {
+        if (other.size_ == 0)
+            return;
+        allocate(other.capacity);
+        memcpy(this->ctrl.get(), other.ctrl.get(),
+               other.capacity + Group::width);
+        for (size_t i = 0; i < other.capacity; ++i) {
+            if (is_full(other.ctrl[i]))
+                new (&this->slots[i]) Value(other.slots[i]);
+        }
+        this->size_ = other.size_;
+        this->growth_left = other.growth_left;
+    }
+
+    Table(Table &&other) noexcept {
+        swap(other);
+    }
+
+    Table &operator=(const Table &other) {
+        if (this != &other) {
+            Table copy(other);
+            swap(copy);
+        }
+        return *this;
+    }
+
+    Table &operator=(Table &&other) noexcept {
+        Table moved(std::move(other));
+        swap(moved);
+        return *this;
+    }
+
+    ~Table() {
+        destroy();
+    }
+
+    void swap(Table &other) noexcept {
+        std::swap(this->ctrl, other.ctrl);
+        std::swap(this->slots, other.slots);
+        std::swap(this->capacity, other.capacity);
+        std::swap(this->size_, other.size_);
+        std::swap(this->growth_left, other.growth_left);
+    }
+
+    iterator begin() {
+        return iterator(this, next_full(0));
+    }
+
+    iterator end() {
+        return iterator(this, this->capacity);
+    }
+
+    const_iterator begin() const {
+        return const_iterator(this, next_full(0));
+    }
+
+    const_iterator end() const {
+        return const_iterator(this, this->capacity);
+    }
+
+    size_t size() const {
+        return this->size_;
+    }
+
+    bool empty() const {
+        return this->size_ == 0;
+    }
+
+    void clear() {
+        if (this->capacity == 0)
+            return;
+        for (size_t i = 0; i < this->capacity; ++i) {
+            if (is_full(this->ctrl[i]))
+                this->slots[i].~Value();
+        }
+        memset(this->ctrl.get(), Control::empty,
+               this->capacity + Group::width);
+        this->size_ = 0;
+        this->growth_left = max_load(this->capacity);
+    }
+
+    // Make room for at least count elements.
+    void reserve(size_t count) {
+        if (count <= this->size_ + this->growth_left)
+            return;
+        size_t new_capacity = Group::width;
+        while (max_load(new_capacity) < count)
+            new_capacity *= 2;
+        rehash(new_capacity);
+    }
+
+    template <typename K> iterator find(const K &key) {
+        return iterator(this, find_index(key));
+    }
+
+    template <typename K> const_iterator find(const K &key) const {
+        return const_iterator(this, find_index(key));
+    }
+
+    template <typename K> size_t count(const K &key) const {
+        return find_index(key) != this->capacity;
+    }
+
+    template <typename K> size_t erase(const K &key) {
+        size_t index = find_index(key);
+        if (index == this->capacity)
+            return 0;
+        erase_index(index);
+        return 1;
+    }
+
+    // Return the iterator following the removed element.
+    iterator erase(const_iterator iter) {
+        erase_index(iter.index);
+        return iterator(this, next_full(iter.index + 1));
+    }
+
+    iterator erase(iterator iter) {
+        return erase(const_iterator(iter));
+    }
+
+protected:
+    // Insert a new element constructed from args if key isn't present.
+    template <typename K, typename... Args>
+    std::pair<iterator, bool> emplace_unique(const K &key, Args &&...args) {
+        uint64_t hash = mix_hash(HashFn()(key));
+        size_t index = find_index(key, hash);
+        if (index != this->capacity)
+            return {iterator(this, index), false};
+
+        if (this->capacity == 0)
+            rehash(Group::width);
+        index = find_insert_index(hash);
+        if (this->growth_left == 0 && this->ctrl[index] != Control::deleted) {
+            rehash(next_capacity());
+            index = find_insert_index(hash);
+        }
+        new (&this->slots[index]) Value(std::forward<Args>(args)...);
+        if (this->ctrl[index] == Control::empty)
+            --this->growth_left;
+        set_ctrl(index, h2(hash));
+        ++this->size_;
+        return {iterator(this, index), true};
+    }
+
+private:
+    static bool is_full(int8_t ctrl) {
+        return ctrl >= 0;
+    }
+
+    static int8_t h2(uint64_t hash) {
+        return hash & 0x7F;
+    }
+
+    // The table is at most 7/8 full.
+    static size_t max_load(size_t capacity) {
+        return capacity - capacity / 8;
+    }
+
+    // Triangular probing visits all groups of a table whose capacity is a
+    // power of two.
+    class Probe
+    {
+    public:
+        Probe(uint64_t hash, size_t mask)
+            : mask(mask), offset((hash >> 7) & mask) {}
+
+        size_t position() const {
+            return this->offset;
+        }
+
+        void next() {
+            this->step += Group::width;
+            this->offset = (this->offset + this->step) & this->mask;
+        }
+
+    private:
+        size_t mask;
+        size_t offset;
+        size_t step = 0;
+    };
+
+    template <typename K> size_t find_index(const K &key) const {
+        if (this->size_ == 0)
+            return this->capacity;
+        return find_index(key, mix_hash(HashFn()(key)));
+    }
+
+    template <typename K>
+    size_t find_index(const K &key, uint64_t hash) const {
+        if (this->capacity == 0)
+            return 0;
+        size_t mask = this->capacity - 1;
+        for (Probe probe(hash, mask);; probe.next()) {
+            Group group(this->ctrl.get() + probe.position());
+            for (BitMask match = group.match(h2(hash)); match;
+                 match.remove_lowest()) {
+                size_t index = (probe.position() + match.lowest()) & mask;
+                if (KeyEqual()(KeyOf()(this->slots[index]), key))
+                    return index;
+            }
+            if (group.match_empty())
+                return this->capacity;
+        }
+    }
+
+    // There is always at least one empty slot, so this terminates.
+    size_t find_insert_index(uint64_t hash) const {
+        size_t mask = this->capacity - 1;
+        for (Probe probe(hash, mask);; probe.next()) {
+            BitMask match =
+                Group(this->ctrl.get() + probe.position())
+                    .match_empty_or_deleted();
+            if (match)
+                return (probe.position() + match.lowest()) & mask;
+        }
+    }
+
+    size_t next_full(size_t index) const {
+        while (index < this->capacity && !is_full(this->ctrl[index]))
+            ++index;
+        return index;
+    }
+
+    // Control bytes of the first group are cloned after the last control
+    // byte, so a group can be loaded from any position.
+    void set_ctrl(size_t index, int8_t value) {
+        this->ctrl[index] = value;
+        if (index < Group::width)
+            this->ctrl[this->capacity + index] = value;
+    }
+
+    void erase_index(size_t index) {
+        this->slots[index].~Value();
+        set_ctrl(index, Control::deleted);
+        --this->size_;
+    }
+
+    // Reclaim deleted slots if there are many of them, grow the table
+    // otherwise.
+    size_t next_capacity() const {
+        if (this->size_ <= max_load(this->capacity) / 2)
+            return this->capacity;
+        return this->capacity * 2;
+    }
+
+    void allocate(size_t capacity) {
+        this->ctrl.reset(new int8_t[capacity + Group::width]);
+        memset(this->ctrl.get(), Control::empty, capacity + Group::width);
+        this->slots = std::allocator<Value>().allocate(capacity);
+        this->capacity = capacity;
+        this->growth_left = max_load(capacity);
+    }
+
+    void rehash(size_t new_capacity) {
+        std::unique_ptr<int8_t[]> old_ctrl = std::move(this->ctrl);
+        Value *old_slots = this->slots;
+        size_t old_capacity = this->capacity;
+
+        allocate(new_capacity);
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (!is_full(old_ctrl[i]))
+                continue;
+            uint64_t hash = mix_hash(HashFn()(KeyOf()(old_slots[i])));
+            size_t index = find_insert_index(hash);
+            new (&this->slots[index]) Value(std::move(old_slots[i]));
+            old_slots[i].~Value();
+            set_ctrl(index, h2(hash));
+        }
+        this->growth_left -= this->size_;
+        if (old_slots)
+            std::allocator<Value>().deallocate(old_slots, old_capacity);
+    }
+
+    void destroy() {
+        if (this->capacity == 0)
+            return;
+        for (size_t i = 0; i < this->capacity; ++i) {
+            if (is_full(this->ctrl[i]))
+                this->slots[i].~Value();
+        }
+        std::allocator<Value>().deallocate(this->slots, this->capacity);
+        this->slots = nullptr;
+        this->ctrl.reset();
+        this->capacity = this->size_ = this->growth_left = 0;
+    }
+
+    std::unique_ptr<int8_t[]> ctrl;
+    Value *slots = nullptr;
+    // This is either 0 or a power of two which is at least Group::width.
+    size_t capacity = 0;
+    size_t size_ = 0;
+    // Number of empty slots which can be filled before the table has to be
+    // rehashed.
+    size_t growth_left = 0;
+
+    static_assert(std::is_nothrow_move_constructible_v<Value>);
+};
+
+template <typename Key, typename T> struct MapKeyOf
+{
+    const Key &operator()(const std::pair<const Key, T> &value) const {
+        return value.first;
+    }
+};
+
+template <typename Key> struct SetKeyOf
+{
+    const Key &operator()(const Key &value) const {
+        return value;
+    }
+};
+}; // namespace FlatHash
+
+template <typename Key, typename T, typename Hash = FlatHash::Hash,
+          typename KeyEqual = std::equal_to<>>
+class FlatHashMap
+    : public FlatHash::Table<Key, std::pair<const Key, T>,
+                             FlatHash::MapKeyOf<Key, T>, Hash, KeyEqual>
+{
+    using base = FlatHash::Table<Key, std::pair<const Key, T>,
+                                 FlatHash::MapKeyOf<Key, T>, Hash, KeyEqual>;
+
+public:
+    using mapped_type = T;
+    using typename base::iterator;
+
+    template <typename K, typename... Args>
+    std::pair<iterator, bool> try_emplace(K &&key, Args &&...args) {
+        return this->emplace_unique(key, std::piecewise_construct,
+                                    std::forward_as_tuple(std::forward<K>(key)),
+                                    std::forward_as_tuple(
+                                        std::forward<Args>(args)...));
+    }
+
+    template <typename K, typename V>
+    std::pair<iterator, bool> emplace(K &&key, V &&value) {
+        return try_emplace(std::forward<K>(key), std::forward<V>(value));
+    }
+
+    template <typename K> T &operator[](K &&key) {
+        return try_emplace(std::forward<K>(key)).first->second;
+    }
+};
+
+template <typename Key, typename Hash = FlatHash::Hash,
+          typename KeyEqual = std::equal_to<>>
+class FlatHashSet
+    : public FlatHash::Table<Key, Key, FlatHash::SetKeyOf<Key>, Hash, KeyEqual>
+{
+    using base =
+        FlatHash::Table<Key, Key, FlatHash::SetKeyOf<Key>, Hash, KeyEqual>;
+
+public:
+    using typename base::iterator;
+
+    // The key is constructed only if it isn't present already.
+    template <typename K> std::pair<iterator, bool> insert(K &&key) {
+        return this->emplace_unique(key, std::forward<K>(key));
+    }
+
+    template <typename K> std::pair<iterator, bool> emplace(K &&key) {
+        return insert(std::forward<K>(key));
+    }
+};
+
+#endif
@@ -30,7 +30,8 @@ string appformatter_default(string_view name, const Application &) {
 
 string appformatter_with_binary_name(string_view name, const Application &app) {
     // get name and the first part of exec
-    return (string)name + " (" + app.exec.substr(0, app.exec.find(' ')) + ")";
+    return (string)name + " (" +
+           (string)app.exec.substr(0, app.exec.find(' ')) + ")";
 }
 
 string appformatter_with_base_binary_name(string_view name,
@@ -45,5 +46,6 @@ string appformatter_with_base_binary_name(string_view name,
     if (command_end != string::npos)
         command_end -= last_slash; // make command_end an offset from last_slash
 
-    return (string)name + " (" + app.exec.substr(last_slash, command_end) + ")";
+    return (string)name + " (" +
+           (string)app.exec.substr(last_slash, command_end) + ")";
 }
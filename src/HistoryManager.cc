@@ -29,11 +29,11 @@
 #include <string_view>
 #include <tuple>
 #include <unistd.h>
-#include <unordered_set>
 #include <utility>
 
 #include "AppManager.hh"
 #include "Application.hh"
+#include "FlatHashMap.hh"
 #include "LineReader.hh"
 
 constexpr static int compare_versions(unsigned int major, unsigned int minor) {
@@ -185,7 +185,7 @@ HistoryManager HistoryManager::convert_history_from_v0(const string &path,
     // history entries from highest to lowest. History entries with highest
     // history count will naturally have higher precedence thanks to this
     // parsing.
-    std::unordered_set<string_view> ensure_uniqueness;
+    FlatHashSet<string_view> ensure_uniqueness;
 
     LineReader liner;
 
@@ -199,7 +199,7 @@ HistoryManager HistoryManager::convert_history_from_v0(const string &path,
         line[rsize - 1] = '\0'; // Get rid of \n
         try {
             auto lookup = appm.lookup_by_ID(line);
-            const Application &app = lookup.value();
+            const Application &app = *appm.resolve(lookup.value());
             if (ensure_uniqueness.emplace(app.name).second)
                 result.emplace(std::piecewise_construct,
                                std::forward_as_tuple(hist_count),
@@ -0,0 +1,280 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "IoUringLoader.hh"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "Utilities.hh"
+
+namespace IoUring
+{
+// Number of files processed in a single batch.
+constexpr unsigned int ring_entries = 64;
+// Most desktop files fit into this. Larger files are read in several steps.
+constexpr size_t initial_buffer_size = 8192;
+
+static int setup(unsigned entries, io_uring_params *params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int enter(int fd, unsigned to_submit, unsigned min_complete,
+                 unsigned flags) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                   nullptr, 0);
+}
+
+static int register_probe(int fd, io_uring_probe *probe, unsigned nr_ops) {
+    return syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe,
+                   nr_ops);
+}
+}; // namespace IoUring
+
+std::unique_ptr<IoUringDesktopFileLoader> IoUringDesktopFileLoader::create() {
+    std::unique_ptr<IoUringDesktopFileLoader> loader(
+        new IoUringDesktopFileLoader);
+    if (!loader->setup())
+        return nullptr;
+    SPDLOG_DEBUG("IoUringLoader: Using io_uring with {} entries.",
+                 loader->entries);
+    return loader;
+}
+
+bool IoUringDesktopFileLoader::setup() {
+    io_uring_params params;
+    memset(&params, 0, sizeof params);
+    this->ring_fd = IoUring::setup(IoUring::ring_entries, &params);
+    if (this->ring_fd == -1) {
+        SPDLOG_DEBUG("IoUringLoader: io_uring_setup() failed: {}",
+                     strerror(errno));
+        return false;
+    }
+    this->entries = params.sq_entries;
+
+    // OPENAT, READ and CLOSE are available since Linux 5.6. Probing itself
+    // is available since 5.6 too.
+    constexpr unsigned nr_ops = 256;
+    constexpr size_t probe_size =
+        sizeof(io_uring_probe) + nr_ops * sizeof(io_uring_probe_op);
+    std::unique_ptr<char[]> probe_buffer(new char[probe_size]());
+    io_uring_probe *probe =
+        reinterpret_cast<io_uring_probe *>(probe_buffer.get());
+    if (IoUring::register_probe(this->ring_fd, probe, nr_ops) == -1) {
+        SPDLOG_DEBUG("IoUringLoader: Couldn't probe io_uring: {}",
+                     strerror(errno));
+        return false;
+    }
+    for (int op : {IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE}) {
+        if (op > probe->last_op ||
+            !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            SPDLOG_DEBUG("IoUringLoader: io_uring operation {} isn't "
+                         "supported.",
+                         op);
+            return false;
+        }
+    }
+
+    this->sq_ring_size =
+        params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    this->cq_ring_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+        this->sq_ring_size = this->cq_ring_size =
+            std::max(this->sq_ring_size, this->cq_ring_size);
+
+    void *ptr = mmap(nullptr, this->sq_ring_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, this->ring_fd,
+                     IORING_OFF_SQ_RING);
+    if (ptr == MAP_FAILED) {
+        SPDLOG_DEBUG("IoUringLoader: mmap() failed: {}", strerror(errno));
+        return false;
+    }
+    this->sq_ring = ptr;
+
+    if (single_mmap)
+        this->cq_ring = this->sq_ring;
+    else {
+        ptr = mmap(nullptr, this->cq_ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, this->ring_fd,
+                   IORING_OFF_CQ_RING);
+        if (ptr == MAP_FAILED) {
+            SPDLOG_DEBUG("IoUringLoader: mmap() failed: {}", strerror(errno));
+            return false;
+        }
+        this->cq_ring = ptr;
+    }
+
+    this->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    ptr = mmap(nullptr, this->sqes_size, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, this->ring_fd, IORING_OFF_SQES);
+    if (ptr == MAP_FAILED) {
+        SPDLOG_DEBUG("IoUringLoader: mmap() failed: {}", strerror(errno));
+        return false;
+    }
+    this->sqes = static_cast<io_uring_sqe *>(ptr);
+
+    char *sq = static_cast<char *>(this->sq_ring);
+    this->sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    this->sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    this->sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    this->sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    char *cq = static_cast<char *>(this->cq_ring);
+    this->cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    this->cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    this->cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    this->cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    this->sq_local_tail = *this->sq_tail;
+    return true;
+}
+
+IoUringDesktopFileLoader::~IoUringDesktopFileLoader() {
+    if (this->sqes)
+        munmap(this->sqes, this->sqes_size);
+    if (this->cq_ring && this->cq_ring != this->sq_ring)
+        munmap(this->cq_ring, this->cq_ring_size);
+    if (this->sq_ring)
+        munmap(this->sq_ring, this->sq_ring_size);
+    if (this->ring_fd != -1)
+        close(this->ring_fd);
+}
+
+io_uring_sqe *IoUringDesktopFileLoader::get_sqe() {
+    unsigned index = this->sq_local_tail & *this->sq_mask;
+    io_uring_sqe *sqe = &this->sqes[index];
+    memset(sqe, 0, sizeof *sqe);
+    this->sq_array[index] = index;
+    ++this->sq_local_tail;
+    ++this->inflight;
+    return sqe;
+}
+
+template <typename F> void IoUringDesktopFileLoader::run(F &&callback) {
+    while (this->inflight > 0) {
+        __atomic_store_n(this->sq_tail, this->sq_local_tail, __ATOMIC_RELEASE);
+        unsigned to_submit = this->sq_local_tail -
+                             __atomic_load_n(this->sq_head, __ATOMIC_ACQUIRE);
+        if (IoUring::enter(this->ring_fd, to_submit, 1,
+                           IORING_ENTER_GETEVENTS) == -1) {
+            if (errno == EINTR)
+                continue;
+            PFATALE("io_uring_enter");
+        }
+
+        unsigned head = *this->cq_head;
+        unsigned tail = __atomic_load_n(this->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe &cqe = this->cqes[head & *this->cq_mask];
+            --this->inflight;
+            callback(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(this->cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+void IoUringDesktopFileLoader::load_batch(const char *const *paths,
+                                          LoadedFile *result,
+                                          unsigned int count) {
+    std::vector<int> fds(count, -1);
+    std::vector<size_t> filled(count, 0);
+
+    // Open all files.
+    for (unsigned int i = 0; i < count; ++i) {
+        io_uring_sqe *sqe = get_sqe();
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uintptr_t>(paths[i]);
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        sqe->user_data = i;
+    }
+    run([&fds, result](uint64_t i, int res) {
+        if (res < 0)
+            result[i].error = -res;
+        else
+            fds[i] = res;
+    });
+
+    // Read them. A read which fills the whole buffer is followed by another
+    // one with a larger buffer.
+    auto queue_read = [this, &fds, &filled, result](unsigned int i) {
+        std::string &contents = result[i].contents;
+        if (contents.size() == filled[i])
+            contents.resize(
+                std::max(IoUring::initial_buffer_size, contents.size() * 2));
+        io_uring_sqe *sqe = get_sqe();
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fds[i];
+        sqe->addr = reinterpret_cast<uintptr_t>(contents.data() + filled[i]);
+        sqe->len = contents.size() - filled[i];
+        sqe->off = filled[i];
+        sqe->user_data = i;
+    };
+    for (unsigned int i = 0; i < count; ++i) {
+        if (fds[i] != -1)
+            queue_read(i);
+    }
+    run([&filled, &queue_read, result](uint64_t i, int res) {
+        std::string &contents = result[i].contents;
+        if (res < 0) {
+            result[i].error = -res;
+            contents.clear();
+            return;
+        }
+        filled[i] += res;
+        if (filled[i] < contents.size())
+            contents.resize(filled[i]);
+        else
+            queue_read(i);
+    });
+
+    // Close them.
+    for (unsigned int i = 0; i < count; ++i) {
+        if (fds[i] == -1)
+            continue;
+        io_uring_sqe *sqe = get_sqe();
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = fds[i];
+        sqe->user_data = i;
+    }
+    run([](uint64_t, int) {});
+}
+
+std::vector<LoadedFile>
+IoUringDesktopFileLoader::load(const std::vector<const char *> &paths) {
+    std::vector<LoadedFile> result(paths.size());
+    for (std::vector<const char *>::size_type i = 0; i < paths.size();
+         i += this->entries) {
+        unsigned int count = std::min<std::vector<const char *>::size_type>(
+            this->entries, paths.size() - i);
+        load_batch(paths.data() + i, result.data() + i, count);
+    }
+    return result;
+}
+
+const char *IoUringDesktopFileLoader::name() const {
+    return "io_uring";
+}
@@ -0,0 +1,90 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef IOURINGLOADER_DEF
+#define IOURINGLOADER_DEF
+
+#include <linux/io_uring.h>
+#include <memory>
+#include <stddef.h>
+#include <vector>
+
+#include "DesktopFileLoader.hh"
+
+// This loader submits opens, reads and closes of many desktop files at once
+// through io_uring. Each batch of (up to ring size) files takes a few
+// io_uring_enter() calls instead of several syscalls per file.
+//
+// io_uring is used directly through syscalls, liburing isn't required.
+class IoUringDesktopFileLoader final : public DesktopFileLoader
+{
+public:
+    // Return nullptr if io_uring can't be set up (old kernel, io_uring
+    // disabled by sysctl or seccomp...).
+    static std::unique_ptr<IoUringDesktopFileLoader> create();
+
+    ~IoUringDesktopFileLoader();
+
+    IoUringDesktopFileLoader(const IoUringDesktopFileLoader &) = delete;
+    void operator=(const IoUringDesktopFileLoader &) = delete;
+
+    std::vector<LoadedFile>
+    load(const std::vector<const char *> &paths) override;
+
+    const char *name() const override;
+
+private:
+    IoUringDesktopFileLoader() = default;
+
+    bool setup();
+
+    // Queue a submission. The caller must ensure that there are at most
+    // entries submissions in flight.
+    io_uring_sqe *get_sqe();
+    // Submit all queued submissions and wait until all of them complete.
+    // callback(user_data, res) is called for each completion, it may queue
+    // further submissions.
+    template <typename F> void run(F &&callback);
+
+    void load_batch(const char *const *paths, LoadedFile *result,
+                    unsigned int count);
+
+    int ring_fd = -1;
+    unsigned int entries = 0;
+
+    void *sq_ring = nullptr;
+    size_t sq_ring_size = 0;
+    void *cq_ring = nullptr;
+    size_t cq_ring_size = 0;
+    io_uring_sqe *sqes = nullptr;
+    size_t sqes_size = 0;
+
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    io_uring_cqe *cqes;
+
+    // Our copy of *sq_tail, it is published in run().
+    unsigned sq_local_tail = 0;
+    unsigned int inflight = 0;
+};
+
+#endif
@@ -17,8 +17,14 @@
 
 #include "LineReader.hh"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Utilities.hh"
 
 LineReader::LineReader() {}
 
@@ -49,3 +55,34 @@ ssize_t LineReader::getline(FILE *f) {
 char *LineReader::get_lineptr() {
     return this->lineptr;
 }
+
+char *LineReader::read_file(const char *path, size_t &length) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+    OnExit close_fd = [fd]() {
+        auto saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+    };
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+        return NULL;
+    size_t size = st.st_size;
+    if (this->lineptr == NULL || this->linesz < size + 1) {
+        char *new_lineptr = (char *)realloc(this->lineptr, size + 1);
+        if (new_lineptr == NULL)
+            return NULL;
+        this->lineptr = new_lineptr;
+        this->linesz = size + 1;
+    }
+
+    ssize_t len = readn(fd, this->lineptr, size);
+    if (len == -1)
+        return NULL;
+    // The file might have been truncated in the meantime.
+    this->lineptr[len] = '\0';
+    length = len;
+    return this->lineptr;
+}
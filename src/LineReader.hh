@@ -18,6 +18,8 @@
 // j4-dmenu-desktop needs to use getline() a lot because of it's reliance on C's
 // IO. Here it is wrapped in a class to C++ify it a bit and to handle free()
 // properly in the dtor.
+// The buffer can also be used to read a whole file at once (this is what
+// Application does), so reading many files doesn't need many allocations.
 
 #ifndef LINEREADER_DEF
 #define LINEREADER_DEF
@@ -45,9 +47,16 @@ public:
 
     char *get_lineptr();
 
+    // Read the whole file at path to the internal buffer using a single read()
+    // (if the file doesn't change in the meantime). The contents are NUL
+    // terminated, length doesn't include the terminator. The returned buffer
+    // is valid until the next call to getline() or read_file(). Return NULL
+    // and set errno on error.
+    char *read_file(const char *path, size_t &length);
+
 private:
     char *lineptr = NULL;
-    size_t linesz;
+    size_t linesz = 0;
 };
 
 #endif
@@ -52,12 +52,9 @@ LocaleSuffixes::LocaleSuffixes(std::string locale) {
 
     this->suffixes[0] = locale;
 
-    if (uscorepos == 0 && atpos == 0) {
+    if (uscorepos == 0 && atpos == 0)
         this->length = 1;
-        return;
-    }
-
-    if (uscorepos != 0 && atpos != 0) {
+    else if (uscorepos != 0 && atpos != 0) {
         this->suffixes[1] = locale.substr(0, atpos);
         this->suffixes[2] = locale.substr(0, uscorepos) + locale.substr(atpos);
         this->suffixes[3] = locale.substr(0, uscorepos);
@@ -65,9 +62,28 @@ LocaleSuffixes::LocaleSuffixes(std::string locale) {
         this->length = 2;
         this->suffixes[1] = locale.substr(0, (atpos == 0 ? uscorepos : atpos));
     }
+
+    compile_matcher();
+}
+
+void LocaleSuffixes::compile_matcher() {
+    for (int i = 0; i < this->length; i++) {
+        size_t size = this->suffixes[i].size();
+        this->length_mask |= 1u << std::min<size_t>(size, 31);
+    }
+    if (!this->suffixes[0].empty())
+        this->first_char = this->suffixes[0][0];
 }
 
 int LocaleSuffixes::match(std::string_view str) const {
+    // Desktop files usually contain many translations, most of them are
+    // rejected here without comparing whole strings.
+    if (!(this->length_mask & (1u << std::min<size_t>(str.size(), 31))))
+        return -1;
+    // A suffix with the same length as str exists. If str isn't empty, that
+    // suffix isn't empty either and it begins with first_char.
+    if (!str.empty() && str[0] != this->first_char)
+        return -1;
     for (int i = 0; i < this->length; i++) {
         if (suffixes[i] == str)
             return i;
@@ -89,6 +105,15 @@ LocaleSuffixes::list_suffixes_for_logging_only() const {
     return result;
 }
 
+std::string LocaleSuffixes::serialize() const {
+    std::string result;
+    for (int i = 0; i < this->length; ++i) {
+        result += this->suffixes[i];
+        result += ';';
+    }
+    return result;
+}
+
 std::string LocaleSuffixes::set_locale() {
     char *user_locale = setlocale(LC_MESSAGES, "");
     if (!user_locale) {
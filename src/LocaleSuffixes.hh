@@ -18,6 +18,7 @@
 #ifndef LOCALE_DEF
 #define LOCALE_DEF
 
+#include <stdint.h>
 #include <string>
 #include <string_view>
 #include <type_traits>
@@ -43,13 +44,26 @@ public:
     // the primary way to match locales.
     std::vector<const std::string *> list_suffixes_for_logging_only() const;
 
+    // Return a string which uniquely identifies the suffixes. This is used to
+    // invalidate AppCache when the locale changes.
+    std::string serialize() const;
+
 private:
+    // This is called at the end of the ctor to precompute the fields below.
+    void compile_matcher();
+
     std::string suffixes[4];
     // There are three possible values of length:
     // 1 - there is only a single variation of the current locale - lang
     // 2 - there are two variations - lang@MODIFIER and lang_COUNTRY
     // 4 - all four variations are valid - lang_COUNTRY@MODIFIER
     int length = 4;
+    // Precompiled matcher used by match() to quickly reject locales which
+    // can't match. Bit N is set if a suffix has length N (lengths 31 and
+    // longer all share the last bit). All suffixes begin with the same
+    // language code, so they also share the first character.
+    uint32_t length_mask = 0;
+    char first_char = '\0';
 
     static std::string set_locale();
 };
@@ -0,0 +1,117 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "MenuCache.hh"
+
+#include <spdlog/spdlog.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utility>
+
+#include "Utilities.hh"
+
+// The cache file has the following format:
+//
+//     J4DDMENUCACHE_HEADER
+//     <length of key in decimal>\n
+//     <key><payload>
+MenuCache::MenuCache(std::string path, std::string key)
+    : path(std::move(path)), key(std::move(key)) {
+    std::string buf;
+    if (!read_file(this->path, buf)) {
+        if (errno == ENOENT)
+            SPDLOG_INFO("MenuCache: Cache file '{}' doesn't exist yet.",
+                        this->path);
+        else
+            SPDLOG_WARN("Couldn't read menu cache file '{}': {}", this->path,
+                        strerror(errno));
+        return;
+    }
+
+    if (buf.compare(0, J4DDMENUCACHE_HEADER_LENGTH, J4DDMENUCACHE_HEADER) !=
+        0) {
+        SPDLOG_WARN("Menu cache file '{}' has unknown format, ignoring it...",
+                    this->path);
+        return;
+    }
+
+    const char *key_length_start = buf.c_str() + J4DDMENUCACHE_HEADER_LENGTH;
+    char *key_length_end;
+    errno = 0;
+    unsigned long key_length = strtoul(key_length_start, &key_length_end, 10);
+    if (errno != 0 || key_length_end == key_length_start ||
+        *key_length_end != '\n' ||
+        key_length > buf.size() - (key_length_end + 1 - buf.c_str())) {
+        SPDLOG_WARN("Menu cache file '{}' is malformed, ignoring it...",
+                    this->path);
+        return;
+    }
+
+    std::string::size_type key_start = key_length_end + 1 - buf.c_str();
+    if (buf.compare(key_start, key_length, this->key) != 0) {
+        SPDLOG_INFO("MenuCache: Cache file '{}' has been created with "
+                    "different configuration, ignoring it...",
+                    this->path);
+        return;
+    }
+
+    buf.erase(0, key_start + key_length);
+    this->payload = std::move(buf);
+    SPDLOG_DEBUG("MenuCache: Loaded {} bytes from '{}'.",
+                 this->payload->size(), this->path);
+}
+
+const std::optional<std::string> &MenuCache::view() const {
+    return this->payload;
+}
+
+void MenuCache::update(std::string payload) {
+    if (this->payload && *this->payload == payload) {
+        SPDLOG_DEBUG("MenuCache: Cache is up to date, not saving.");
+        return;
+    }
+
+    std::string buf = J4DDMENUCACHE_HEADER;
+    buf += std::to_string(this->key.size());
+    buf += '\n';
+    buf += this->key;
+    buf += payload;
+
+    if (!write_file_atomically(this->path, buf)) {
+        SPDLOG_WARN("Couldn't write menu cache file '{}': {}", this->path,
+                    strerror(errno));
+        return;
+    }
+    SPDLOG_DEBUG("MenuCache: Saved {} bytes to '{}'.", payload.size(),
+                 this->path);
+    this->payload = std::move(payload);
+}
+
+bool MenuCache::payload_contains(std::string_view payload,
+                                 std::string_view name) {
+    std::string_view::size_type pos = 0;
+    while ((pos = payload.find(name, pos)) != std::string_view::npos) {
+        bool starts_line = pos == 0 || payload[pos - 1] == '\n';
+        std::string_view::size_type end = pos + name.size();
+        if (starts_line && end < payload.size() && payload[end] == '\n')
+            return true;
+        ++pos;
+    }
+    return false;
+}
@@ -0,0 +1,64 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef MENUCACHE_DEF
+#define MENUCACHE_DEF
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#define J4DDMENUCACHE_HEADER "j4dd menu cache v1\n"
+#define J4DDMENUCACHE_HEADER_LENGTH 19
+
+// MenuCache persists the menu payload (the formatted and history ordered list
+// of names sent to dmenu, each name is terminated by a newline). It is used by
+// --optimistic-menu to show the menu before desktop files have been collected
+// and parsed.
+//
+// The cached payload is used only if its key matches the key passed to the
+// ctor. The key must describe everything that influences the payload.
+class MenuCache
+{
+public:
+    // The cache file is read in the ctor (if it exists). Errors are logged,
+    // but they aren't fatal.
+    MenuCache(std::string path, std::string key);
+
+    MenuCache(const MenuCache &) = delete;
+    void operator=(const MenuCache &) = delete;
+
+    // Return the cached payload if there is a valid one.
+    const std::optional<std::string> &view() const;
+
+    // Save the payload if it differs from the cached one.
+    void update(std::string payload);
+
+    // Return true if the payload contains the name.
+    static bool payload_contains(std::string_view payload,
+                                 std::string_view name);
+
+private:
+    std::string path;
+    std::string key;
+    std::optional<std::string> payload;
+};
+
+static_assert(!std::is_copy_constructible_v<MenuCache>);
+
+#endif
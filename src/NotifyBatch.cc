@@ -0,0 +1,80 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "NotifyBatch.hh"
+
+#include <algorithm>
+#include <iterator>
+#include <stddef.h>
+#include <string_view>
+#include <utility>
+
+#include "FlatHashMap.hh"
+
+NotifyBatch::NotifyBatch(std::chrono::milliseconds delay) : delay(delay) {}
+
+void NotifyBatch::add(std::vector<NotifyBase::FileChange> changes,
+                      clock::time_point now) {
+    if (changes.empty())
+        return;
+    if (this->changes.empty())
+        this->first_change = now;
+    this->last_change = now;
+    this->changes.insert(this->changes.end(),
+                         std::make_move_iterator(changes.begin()),
+                         std::make_move_iterator(changes.end()));
+}
+
+bool NotifyBatch::empty() const {
+    return this->changes.empty();
+}
+
+bool NotifyBatch::is_due(clock::time_point now) const {
+    return !this->changes.empty() && get_timeout(now) == 0;
+}
+
+int NotifyBatch::get_timeout(clock::time_point now) const {
+    if (this->changes.empty())
+        return -1;
+    clock::time_point due =
+        std::min(this->last_change + this->delay,
+                 this->first_change + max_delay_factor * this->delay);
+    if (due <= now)
+        return 0;
+    // Round up, poll() would otherwise wake up too early.
+    return std::chrono::ceil<std::chrono::milliseconds>(due - now).count();
+}
+
+std::vector<NotifyBase::FileChange> NotifyBatch::take() {
+    // Names of different ranks are different files.
+    std::vector<FlatHashSet<std::string_view>> seen;
+    std::vector<bool> is_last(this->changes.size());
+    for (size_t i = this->changes.size(); i-- > 0;) {
+        const NotifyBase::FileChange &change = this->changes[i];
+        if (change.rank >= (int)seen.size())
+            seen.resize(change.rank + 1);
+        is_last[i] = seen[change.rank].insert(change.name).second;
+    }
+
+    std::vector<NotifyBase::FileChange> result;
+    for (size_t i = 0; i < this->changes.size(); ++i) {
+        if (is_last[i])
+            result.push_back(std::move(this->changes[i]));
+    }
+    this->changes.clear();
+    return result;
+}
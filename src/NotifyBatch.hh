@@ -0,0 +1,63 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef NOTIFYBATCH_DEF
+#define NOTIFYBATCH_DEF
+
+#include <chrono>
+#include <vector>
+
+#include "NotifyBase.hh"
+
+// NotifyBatch collects changes reported by NotifyBase in wait-on mode, so that
+// they can be applied to AppManager at once. Package managers usually modify
+// many desktop files in a quick succession.
+//
+// The batch becomes due when no change has been added for delay, but no later
+// than max_delay_factor * delay after its first change. A delay of zero makes
+// the batch due immediately, changes are then merged only within a single
+// wakeup.
+class NotifyBatch
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr int max_delay_factor = 10;
+
+    explicit NotifyBatch(std::chrono::milliseconds delay);
+
+    void add(std::vector<NotifyBase::FileChange> changes,
+             clock::time_point now);
+    bool empty() const;
+    bool is_due(clock::time_point now) const;
+    // Return the timeout for poll() in milliseconds until the batch is due or
+    // -1 if it's empty.
+    int get_timeout(clock::time_point now) const;
+
+    // Return all changes and clear the batch. Only the last change of each
+    // file is returned (a modification followed by a deletion is a deletion
+    // and vice versa). Changes are ordered by their last occurrence.
+    std::vector<NotifyBase::FileChange> take();
+
+private:
+    std::chrono::milliseconds delay;
+    std::vector<NotifyBase::FileChange> changes;
+    clock::time_point first_change;
+    clock::time_point last_change;
+};
+
+#endif
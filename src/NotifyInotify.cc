@@ -17,45 +17,153 @@
 
 #include "NotifyInotify.hh"
 
+#include <spdlog/spdlog.h>
+
 #include <errno.h>
+#include <mutex>
+#include <stdexcept>
 #include <stdio.h>
+#include <string.h>
 #include <sys/inotify.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <utility>
 
+#include "DesktopFileScanner.hh"
 #include "FileFinder.hh"
 
 NotifyInotify::directory_entry::directory_entry(int r, std::string p)
     : rank(r), path(std::move(p)) {}
 
-NotifyInotify::NotifyInotify(const stringlist_t &search_path) {
+NotifyInotify::NotifyInotify(const stringlist_t &search_path,
+                             bool close_write)
+    : mask(IN_DELETE | IN_MOVE | IN_CREATE |
+           (close_write ? IN_CLOSE_WRITE : IN_MODIFY)),
+      search_path(search_path), known_files(search_path.size()) {
     inotifyfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
     if (inotifyfd == -1)
         PFATALE("inotify_init");
 
+    std::vector<std::string> found;
     for (int i = 0; i < (int)search_path.size();
          i++) // size() is converted to int to silent warnings about
               // narrowing when adding i to directories
     {
-        int wd = inotify_add_watch(inotifyfd, search_path[i].c_str(),
-                                   IN_DELETE | IN_MODIFY | IN_MOVE);
-        if (wd == -1)
+        found.clear();
+        if (!watch_directory(i, {}, found))
             PFATALE("inotify_add_watch");
-        directories.insert({
-            wd, {i, {}}
+        for (std::string &name : found)
+            this->known_files[i].insert(std::move(name));
+    }
+}
+
+NotifyInotify::NotifyInotify(const stringlist_t &search_path,
+                             bool close_write, ThreadPool &pool,
+                             Desktop_file_list &files)
+    : mask(IN_DELETE | IN_MOVE | IN_CREATE |
+           (close_write ? IN_CLOSE_WRITE : IN_MODIFY)),
+      search_path(search_path), known_files(search_path.size()) {
+    inotifyfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyfd == -1)
+        PFATALE("inotify_init");
+
+    std::mutex mutex;
+    int root_error = 0;
+    files = scan_desktop_files(
+        search_path, pool, [&](int rank, const std::string &path) {
+            int wd = inotify_add_watch(this->inotifyfd, path.c_str(),
+                                       this->mask);
+            std::string relative = path.substr(search_path[rank].size());
+            std::lock_guard lock(mutex);
+            if (wd == -1) {
+                if (relative.empty())
+                    root_error = errno;
+                else
+                    SPDLOG_WARN("Couldn't watch directory '{}': {}", path,
+                                strerror(errno));
+                return;
+            }
+            this->directories.insert_or_assign(
+                wd, directory_entry(rank, std::move(relative)));
         });
-        FileFinder find(search_path[i]);
+    if (root_error != 0) {
+        errno = root_error;
+        PFATALE("inotify_add_watch");
+    }
+
+    for (int i = 0; i < (int)files.size(); i++) {
+        for (const std::string &file : files[i].files)
+            this->known_files[i].insert(
+                std::string_view(file).substr(search_path[i].size()));
+    }
+}
+
+bool NotifyInotify::watch_directory(int rank, const std::string &path,
+                                    std::vector<std::string> &found) {
+    const std::string &base = this->search_path[rank];
+    std::string dirpath = base + path;
+    int wd = inotify_add_watch(this->inotifyfd, dirpath.c_str(), this->mask);
+    if (wd == -1)
+        return false;
+    // A directory which is already watched keeps its watch descriptor.
+    this->directories.insert_or_assign(wd, directory_entry(rank, path));
+
+    try {
+        FileFinder find(dirpath);
         while (++find) {
-            if (!find.isdir())
+            std::string relative = find.path().substr(base.size());
+            if (!find.isdir()) {
+                if (endswith(relative, ".desktop"))
+                    found.push_back(std::move(relative));
+                continue;
+            }
+            wd = inotify_add_watch(this->inotifyfd, find.path().c_str(),
+                                   this->mask);
+            if (wd == -1) {
+                SPDLOG_WARN("Couldn't watch directory '{}': {}", find.path(),
+                            strerror(errno));
                 continue;
-            wd = inotify_add_watch(inotifyfd, find.path().c_str(),
-                                   IN_DELETE | IN_MODIFY);
-            directories.insert({
-                wd, {i, find.path().substr(search_path[i].length()) + '/'}
-            });
+            }
+            this->directories.insert_or_assign(
+                wd, directory_entry(rank, relative + '/'));
         }
+    } catch (const std::runtime_error &e) {
+        // The directory might have been removed in the meantime.
+        SPDLOG_WARN("Couldn't read directory '{}': {}", dirpath, e.what());
     }
+    return true;
+}
+
+void NotifyInotify::unwatch_directory(int rank, const std::string &path) {
+    for (auto iter = this->directories.begin();
+         iter != this->directories.end();) {
+        if (iter->second.rank == rank && startswith(iter->second.path, path)) {
+            inotify_rm_watch(this->inotifyfd, iter->first);
+            iter = this->directories.erase(iter);
+        } else
+            ++iter;
+    }
+}
+
+void NotifyInotify::rescan(int rank, std::vector<FileChange> &result) {
+    SPDLOG_INFO("Rescanning desktop files in '{}'...",
+                this->search_path[rank]);
+    std::vector<std::string> found;
+    if (!watch_directory(rank, {}, found)) {
+        SPDLOG_WARN("Couldn't watch directory '{}': {}",
+                    this->search_path[rank], strerror(errno));
+    }
+
+    FlatHashSet<std::string> present;
+    for (std::string &name : found)
+        present.insert(std::move(name));
+    for (const std::string &name : this->known_files[rank]) {
+        if (!present.count(name))
+            result.emplace_back(rank, name, changetype::deleted);
+    }
+    for (const std::string &name : present)
+        result.emplace_back(rank, name, changetype::modified);
+    this->known_files[rank] = std::move(present);
 }
 
 int NotifyInotify::getfd() const {
@@ -65,7 +173,10 @@ int NotifyInotify::getfd() const {
 std::vector<NotifyInotify::FileChange> NotifyInotify::getchanges() {
     char buffer alignas(inotify_event)[4096];
     ssize_t len;
-    std::vector<FileChange> result;
+    std::vector<FileChange> changes;
+    std::vector<size_t> event_counts(this->search_path.size());
+    std::vector<bool> needs_rescan(this->search_path.size());
+    std::vector<std::string> found;
 
     while ((len = read(inotifyfd, buffer, sizeof buffer)) > 0) {
         const inotify_event *event;
@@ -73,19 +184,81 @@ std::vector<NotifyInotify::FileChange> NotifyInotify::getchanges() {
              ptr += sizeof(inotify_event) + event->len) {
             event = reinterpret_cast<const inotify_event *>(ptr);
 
-            const auto &dir = directories.at(event->wd);
+            if (event->mask & IN_Q_OVERFLOW) {
+                SPDLOG_WARN("inotify event queue has overflowed, rescanning "
+                            "all desktop files.");
+                needs_rescan.assign(needs_rescan.size(), true);
+                continue;
+            }
+
+            auto dir = directories.find(event->wd);
+            // Events of removed watches may still be queued.
+            if (dir == directories.end())
+                continue;
+            if (event->mask & IN_IGNORED) {
+                directories.erase(dir);
+                continue;
+            }
+            if (event->len == 0)
+                continue;
+            int rank = dir->second.rank;
+            std::string path = dir->second.path + event->name;
+            ++event_counts[rank];
 
-            if (event->mask & IN_MODIFY || event->mask & IN_MOVED_TO)
-                result.push_back(
-                    {dir.rank, dir.path + event->name, changetype::modified});
+            if (event->mask & IN_ISDIR) {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    found.clear();
+                    watch_directory(rank, path + '/', found);
+                    for (std::string &name : found)
+                        changes.emplace_back(rank, std::move(name),
+                                             changetype::modified);
+                } else if (event->mask & IN_MOVED_FROM) {
+                    // No events are generated for the contents of the moved
+                    // directory.
+                    unwatch_directory(rank, path + '/');
+                    needs_rescan[rank] = true;
+                }
+                // Removed directories are empty, their watches are removed
+                // by IN_IGNORED.
+                continue;
+            }
+
+            // Created files are reported once they have been written to.
+            if (event->mask & IN_CREATE)
+                continue;
+            if (event->mask & (IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO))
+                changes.emplace_back(rank, std::move(path),
+                                     changetype::modified);
             else // IN_DELETE or IN_MOVED_FROM
-                result.push_back(
-                    {dir.rank, dir.path + event->name, changetype::deleted});
+                changes.emplace_back(rank, std::move(path),
+                                     changetype::deleted);
         }
     }
 
     if (len == -1 && errno != EAGAIN)
         perror("read");
 
+    for (size_t rank = 0; rank < event_counts.size(); ++rank) {
+        if (event_counts[rank] > rescan_threshold)
+            needs_rescan[rank] = true;
+    }
+
+    std::vector<FileChange> result;
+    for (FileChange &change : changes) {
+        if (needs_rescan[change.rank])
+            continue;
+        if (endswith(change.name, ".desktop")) {
+            if (change.status == changetype::modified)
+                this->known_files[change.rank].insert(change.name);
+            else
+                this->known_files[change.rank].erase(change.name);
+        }
+        result.push_back(std::move(change));
+    }
+    for (int rank = 0; rank < (int)needs_rescan.size(); ++rank) {
+        if (needs_rescan[rank])
+            rescan(rank, result);
+    }
+
     return result;
 }
@@ -18,17 +18,30 @@
 #ifndef NOTIFYINOTIFY_DEV
 #define NOTIFYINOTIFY_DEV
 
+#include <stddef.h>
+#include <stdint.h>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "AppManager.hh"
+#include "FlatHashMap.hh"
 #include "NotifyBase.hh"
+#include "ThreadPool.hh"
 #include "Utilities.hh"
 
+// Subdirectories created after construction are watched too and desktop files
+// which are already in them are reported. If the event queue overflows or if
+// a rank has too many changes at once, the rank is scanned again and the
+// result is compared with the desktop files known to NotifyInotify. Only
+// differences are reported then (all desktop files present in the rank are
+// reported as modified, AppManager skips the ones which haven't changed).
 class NotifyInotify final : public NotifyBase
 {
 private:
     int inotifyfd;
+    uint32_t mask;
+    stringlist_t search_path;
 
     struct directory_entry
     {
@@ -40,9 +53,36 @@ private:
     };
 
     std::unordered_map<int /* watch descriptor */, directory_entry> directories;
+    // Desktop files (relative to their search path directory) of each rank.
+    std::vector<FlatHashSet<std::string>> known_files;
+
+    // If a single getchanges() receives more events of a rank than this, the
+    // rank is scanned again instead of processing them one by one.
+    static constexpr size_t rescan_threshold = 512;
+
+    // Watch directory search_path[rank] + path (path is empty or it ends with
+    // '/') and all its subdirectories. Desktop files found in them are
+    // appended to found. Subdirectories which can't be read are skipped.
+    // Return false if the directory itself can't be watched.
+    bool watch_directory(int rank, const std::string &path,
+                         std::vector<std::string> &found);
+    // Stop watching directory search_path[rank] + path and its
+    // subdirectories.
+    void unwatch_directory(int rank, const std::string &path);
+    // Scan rank again and append the differences to result.
+    void rescan(int rank, std::vector<FileChange> &result);
 
 public:
-    NotifyInotify(const stringlist_t &search_path);
+    // If close_write is true, modified desktop files are reported once they
+    // have been closed (IN_CLOSE_WRITE) instead of after each write
+    // (IN_MODIFY).
+    NotifyInotify(const stringlist_t &search_path, bool close_write = false);
+    // Walk search path with scan_desktop_files() and watch every directory
+    // before it is read, so desktop files created during the walk aren't
+    // missed. The desktop files found are stored to files, this replaces
+    // a separate scan_desktop_files() call.
+    NotifyInotify(const stringlist_t &search_path, bool close_write,
+                  ThreadPool &pool, Desktop_file_list &files);
 
     NotifyInotify(const NotifyInotify &) = delete;
     void operator=(const NotifyInotify &) = delete;
@@ -0,0 +1,58 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "PageBuffer.hh"
+
+#include <errno.h>
+#include <stdexcept>
+#include <string>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+PageBuffer::~PageBuffer() {
+    if (this->data)
+        munmap(this->data, this->capacity);
+}
+
+void PageBuffer::assign(std::string_view contents) {
+    char *data = reset(contents.size());
+    if (!contents.empty())
+        memcpy(data, contents.data(), contents.size());
+}
+
+char *PageBuffer::reset(size_t size) {
+    if (size > this->capacity) {
+        size_t page_size = sysconf(_SC_PAGESIZE);
+        size_t capacity = (size + page_size - 1) / page_size * page_size;
+        void *data = mmap(nullptr, capacity, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED)
+            throw std::runtime_error(
+                (std::string) "PageBuffer: mmap() failed: " + strerror(errno));
+        if (this->data)
+            munmap(this->data, this->capacity);
+        this->data = static_cast<char *>(data);
+        this->capacity = capacity;
+    }
+    this->size = size;
+    return this->data;
+}
+
+std::string_view PageBuffer::view() const {
+    return {this->data, this->size};
+}
@@ -0,0 +1,53 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef PAGEBUFFER_DEF
+#define PAGEBUFFER_DEF
+
+#include <stddef.h>
+#include <string_view>
+#include <type_traits>
+
+// PageBuffer holds a string in page aligned memory of its own. Its pages can
+// be passed to vmsplice() (see Dmenu::splice_payload()), the pipe then refers
+// to them instead of a copy. The contents mustn't be changed while the pipe
+// refers to them, that is until the reader has consumed them.
+class PageBuffer
+{
+public:
+    PageBuffer() = default;
+    ~PageBuffer();
+
+    PageBuffer(const PageBuffer &) = delete;
+    void operator=(const PageBuffer &) = delete;
+
+    // Replace the contents. Memory is reused if it is large enough.
+    void assign(std::string_view contents);
+    // Replace the contents with size bytes which are left for the caller to
+    // fill through the returned pointer.
+    char *reset(size_t size);
+    std::string_view view() const;
+
+private:
+    char *data = nullptr;
+    size_t size = 0;
+    size_t capacity = 0;
+};
+
+static_assert(!std::is_copy_constructible_v<PageBuffer>);
+
+#endif
@@ -57,3 +57,18 @@ stringlist_t get_search_path() {
                              get_variable("HOME"),
                              get_variable("XDG_DATA_DIRS"), is_directory);
 }
+
+std::string build_cache_directory(std::string xdg_cache_home,
+                                  std::string home) {
+    // The spec says that relative paths should be ignored.
+    if (xdg_cache_home.empty() || xdg_cache_home.front() != '/')
+        xdg_cache_home = home + "/.cache/";
+    if (xdg_cache_home.back() != '/')
+        xdg_cache_home += '/';
+    return xdg_cache_home + "j4-dmenu-desktop/";
+}
+
+std::string get_cache_directory() {
+    return build_cache_directory(get_variable("XDG_CACHE_HOME"),
+                                 get_variable("HOME"));
+}
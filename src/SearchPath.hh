@@ -29,4 +29,11 @@ stringlist_t build_search_path(std::string xdg_data_home, std::string home,
 
 stringlist_t get_search_path();
 
+// Return the directory in which j4-dmenu-desktop should store its cache files
+// ($XDG_CACHE_HOME/j4-dmenu-desktop/). The returned path ends with a slash.
+// The directory might not exist yet.
+std::string build_cache_directory(std::string xdg_cache_home, std::string home);
+
+std::string get_cache_directory();
+
 #endif
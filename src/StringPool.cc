@@ -0,0 +1,100 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "StringPool.hh"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+char *StringPool::allocate(size_t size) {
+    if (this->chunks.empty() ||
+        this->chunks.back().capacity - this->chunks.back().used < size) {
+        // Strings larger than a chunk get their own chunk.
+        size_t capacity = std::max(size, chunk_size);
+        this->chunks.push_back(
+            {std::unique_ptr<char[]>(new char[capacity]), capacity, 0});
+    }
+    Chunk &chunk = this->chunks.back();
+    char *result = chunk.data.get() + chunk.used;
+    chunk.used += size;
+    this->used += size;
+    return result;
+}
+
+std::string_view StringPool::acquire(std::string_view str) {
+    if (str.empty())
+        return "";
+
+    auto iter = this->strings.find(str);
+    if (iter == this->strings.end()) {
+        char *copy = allocate(str.size() + 1);
+        memcpy(copy, str.data(), str.size());
+        copy[str.size()] = '\0';
+        iter = this->strings.emplace(std::string_view(copy, str.size()), 0)
+                   .first;
+    }
+    if (iter->second++ == 0)
+        this->live += str.size() + 1;
+    return iter->first;
+}
+
+void StringPool::release(std::string_view str) {
+    if (str.empty())
+        return;
+
+    auto iter = this->strings.find(str);
+    if (iter == this->strings.end() || iter->second == 0 ||
+        iter->first.data() != str.data()) {
+        SPDLOG_ERROR("StringPool: Tried to release unknown string '{}'!", str);
+        abort();
+    }
+    if (--iter->second == 0)
+        this->live -= str.size() + 1;
+}
+
+std::string_view StringPool::copy(std::string_view str) {
+    if (str.empty())
+        return "";
+
+    char *copy = allocate(str.size() + 1);
+    memcpy(copy, str.data(), str.size());
+    copy[str.size()] = '\0';
+    this->live += str.size() + 1;
+    return std::string_view(copy, str.size());
+}
+
+void StringPool::release_copy(std::string_view str) {
+    if (!str.empty())
+        this->live -= str.size() + 1;
+}
+
+bool StringPool::should_compact() const {
+    // Small pools aren't worth compacting.
+    size_t wasted = this->used - this->live;
+    return wasted > chunk_size && wasted > this->live;
+}
+
+size_t StringPool::live_bytes() const {
+    return this->live;
+}
+
+size_t StringPool::used_bytes() const {
+    return this->used;
+}
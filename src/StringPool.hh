@@ -0,0 +1,100 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef STRINGPOOL_DEF
+#define STRINGPOOL_DEF
+
+#include <memory>
+#include <stddef.h>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "FlatHashMap.hh"
+
+// StringPool stores NUL terminated strings in large chunks of memory.
+//
+// Strings which are likely to be repeated can be interned. Each distinct
+// interned string is stored only once and it is reference counted. Memory of
+// interned strings which are no longer referenced isn't reused, they are kept
+// in the pool and they are revived if they are acquired again (this is
+// common, desktop files are often rewritten without changing their values).
+// Other strings are copied to the pool without being indexed, which is
+// cheaper for unique strings.
+//
+// Memory of removed strings is never reused. The owner of the pool should
+// replace it with a new generation containing only live strings when
+// should_compact() returns true (see AppManager::compact_strings_if_needed()).
+class StringPool
+{
+public:
+    StringPool() = default;
+
+    StringPool(const StringPool &) = delete;
+    StringPool(StringPool &&) = default;
+    void operator=(const StringPool &) = delete;
+    StringPool &operator=(StringPool &&) = default;
+
+    // Return an interned copy of str. It is valid until it's released by
+    // release() as many times as it has been acquired (and until the string
+    // is removed during compaction) or until the pool is destroyed. The
+    // returned string_view is NUL terminated. Empty strings aren't stored in
+    // the pool.
+    std::string_view acquire(std::string_view str);
+
+    // str must be a string_view returned by acquire().
+    void release(std::string_view str);
+
+    // Return a NUL terminated copy of str which isn't interned. Empty strings
+    // aren't stored in the pool.
+    std::string_view copy(std::string_view str);
+
+    // str must be a string_view returned by copy().
+    void release_copy(std::string_view str);
+
+    // Return true if more memory is wasted by removed strings than it is used
+    // by live ones.
+    bool should_compact() const;
+
+    // Number of bytes (including NUL terminators) of live strings.
+    size_t live_bytes() const;
+    // Number of bytes used in all chunks.
+    size_t used_bytes() const;
+
+private:
+    struct Chunk
+    {
+        std::unique_ptr<char[]> data;
+        size_t capacity;
+        size_t used;
+    };
+
+    static constexpr size_t chunk_size = 16 * 1024;
+
+    char *allocate(size_t size);
+
+    std::vector<Chunk> chunks;
+    // string -> reference count
+    FlatHashMap<std::string_view, unsigned int> strings;
+    size_t live = 0;
+    size_t used = 0;
+};
+
+static_assert(!std::is_copy_constructible_v<StringPool>);
+static_assert(std::is_move_constructible_v<StringPool>);
+
+#endif
@@ -0,0 +1,168 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "ThreadPool.hh"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <utility>
+
+// This identifies the queue of the current thread.
+static thread_local const ThreadPool *current_thread_pool = nullptr;
+static thread_local unsigned int current_thread_queue = 0;
+
+ThreadPool::ThreadPool(unsigned int worker_count) {
+    this->queues.reserve(worker_count + 1);
+    for (unsigned int i = 0; i <= worker_count; ++i)
+        this->queues.push_back(std::make_unique<Queue>());
+
+    this->threads.reserve(worker_count);
+    for (unsigned int i = 0; i < worker_count; ++i)
+        this->threads.emplace_back(&ThreadPool::worker_loop, this, i);
+    SPDLOG_DEBUG("ThreadPool: Started {} worker threads.", worker_count);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(this->state_mutex);
+        this->stopping = true;
+    }
+    this->state_cv.notify_all();
+    for (std::thread &thread : this->threads)
+        thread.join();
+}
+
+void ThreadPool::submit(task_type task) {
+    unsigned int index =
+        (current_thread_pool == this ? current_thread_queue
+                                     : this->queues.size() - 1);
+    // The task must be counted before it can be stolen. Otherwise it could
+    // finish before it's counted, and wait() would see no pending tasks while
+    // the submitting task is still running.
+    {
+        std::lock_guard lock(this->state_mutex);
+        ++this->queued;
+        ++this->pending;
+    }
+    {
+        std::lock_guard lock(this->queues[index]->mutex);
+        this->queues[index]->tasks.push_back(std::move(task));
+    }
+    this->state_cv.notify_one();
+}
+
+bool ThreadPool::take_task(unsigned int index, task_type &task) {
+    // Take the newest task from own queue.
+    {
+        Queue &own = *this->queues[index];
+        std::lock_guard lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    // Steal the oldest task from others.
+    for (unsigned int i = 1; i < this->queues.size(); ++i) {
+        Queue &other = *this->queues[(index + i) % this->queues.size()];
+        std::lock_guard lock(other.mutex);
+        if (!other.tasks.empty()) {
+            task = std::move(other.tasks.front());
+            other.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::run_one(unsigned int index) {
+    task_type task;
+    if (!take_task(index, task))
+        return false;
+    {
+        std::lock_guard lock(this->state_mutex);
+        --this->queued;
+    }
+
+    std::exception_ptr task_error;
+    try {
+        task();
+    } catch (...) {
+        task_error = std::current_exception();
+    }
+
+    bool finished;
+    {
+        std::lock_guard lock(this->state_mutex);
+        if (task_error && !this->error)
+            this->error = task_error;
+        finished = --this->pending == 0;
+    }
+    if (finished)
+        this->state_cv.notify_all();
+    return true;
+}
+
+void ThreadPool::worker_loop(unsigned int index) {
+    current_thread_pool = this;
+    current_thread_queue = index;
+
+    while (true) {
+        if (run_one(index))
+            continue;
+        std::unique_lock lock(this->state_mutex);
+        this->state_cv.wait(
+            lock, [this] { return this->stopping || this->queued > 0; });
+        if (this->stopping)
+            return;
+    }
+}
+
+void ThreadPool::wait() {
+    unsigned int index = this->queues.size() - 1;
+    const ThreadPool *saved_pool = std::exchange(current_thread_pool, this);
+    unsigned int saved_queue = std::exchange(current_thread_queue, index);
+
+    while (true) {
+        if (run_one(index))
+            continue;
+        std::unique_lock lock(this->state_mutex);
+        this->state_cv.wait(
+            lock, [this] { return this->pending == 0 || this->queued > 0; });
+        if (this->pending == 0)
+            break;
+    }
+
+    current_thread_pool = saved_pool;
+    current_thread_queue = saved_queue;
+
+    std::exception_ptr task_error;
+    {
+        std::lock_guard lock(this->state_mutex);
+        task_error = std::exchange(this->error, nullptr);
+    }
+    if (task_error)
+        std::rethrow_exception(task_error);
+}
+
+unsigned int ThreadPool::default_worker_count() {
+    // hardware_concurrency() may return 0 if it isn't known. More threads
+    // than this don't help when waiting for a single disk.
+    unsigned int hardware = std::thread::hardware_concurrency();
+    return std::clamp(hardware, 1u, 4u) - 1;
+}
@@ -0,0 +1,95 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef THREADPOOL_DEF
+#define THREADPOOL_DEF
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// ThreadPool is a small work-stealing thread pool.
+//
+// Each worker has its own task queue. Tasks submitted from within a task are
+// pushed to the queue of the current worker, which processes its queue in LIFO
+// order. Idle workers steal the oldest tasks from other queues. This makes
+// recursive workloads (like directory traversal) cheap to distribute.
+//
+// The thread calling wait() participates in executing tasks, so a ThreadPool
+// with zero worker threads executes everything in wait().
+class ThreadPool
+{
+public:
+    using task_type = std::function<void()>;
+
+    explicit ThreadPool(unsigned int worker_count);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    void operator=(const ThreadPool &) = delete;
+
+    // This may be called from any thread, including from within a task.
+    void submit(task_type task);
+
+    // Wait until all submitted tasks (including tasks submitted by other
+    // tasks) have finished. If a task has thrown an exception, it is rethrown
+    // here (the remaining tasks are still executed). This mustn't be called
+    // from within a task.
+    void wait();
+
+    // Return a worker count suitable for I/O bound tasks. The thread calling
+    // wait() isn't included.
+    static unsigned int default_worker_count();
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<task_type> tasks;
+    };
+
+    void worker_loop(unsigned int index);
+    // Execute a single task. The queue with the given index is preferred.
+    // Return false if there is no task to execute.
+    bool run_one(unsigned int index);
+    bool take_task(unsigned int index, task_type &task);
+
+    // The last queue belongs to the thread calling wait() and to threads not
+    // belonging to the pool.
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex state_mutex;
+    std::condition_variable state_cv;
+    // Number of tasks in queues. It is incremented before the task is
+    // queued, so it may temporarily be larger.
+    long queued = 0;
+    // Number of submitted tasks which haven't finished yet.
+    long pending = 0;
+    bool stopping = false;
+    std::exception_ptr error;
+};
+
+static_assert(!std::is_copy_constructible_v<ThreadPool>);
+
+#endif
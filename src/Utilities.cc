@@ -18,7 +18,11 @@
 #include "Utilities.hh"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <iterator>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -72,7 +76,7 @@ void replace(std::string &str, const std::string &substr,
     }
 }
 
-bool endswith(const std::string &str, const std::string &suffix) {
+bool endswith(std::string_view str, std::string_view suffix) {
     if (str.length() < suffix.length())
         return false;
     return str.compare(str.length() - suffix.length(), suffix.length(),
@@ -96,6 +100,113 @@ bool is_directory(const std::string &path) {
     return S_ISDIR(filestat.st_mode);
 }
 
+bool make_directories(const std::string &path) {
+    if (path.empty() || is_directory(path))
+        return true;
+    auto last_slash = path.find_last_of('/', path.find_last_not_of('/'));
+    if (last_slash != std::string::npos && last_slash != 0 &&
+        !make_directories(path.substr(0, last_slash)))
+        return false;
+    return mkdir(path.c_str(), 0700) == 0 || errno == EEXIST;
+}
+
+bool read_file(const std::string &path, std::string &result) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+    OnExit close_fd = [fd]() {
+        auto saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+    };
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+        return false;
+    result.resize(st.st_size);
+    ssize_t len = readn(fd, result.data(), result.size());
+    if (len == -1)
+        return false;
+    // The file might have been truncated in the meantime.
+    result.resize(len);
+    return true;
+}
+
+bool write_file_atomically(const std::string &path,
+                           std::string_view contents) {
+    std::string::size_type last_slash = path.rfind('/');
+    if (last_slash != std::string::npos && last_slash != 0 &&
+        !make_directories(path.substr(0, last_slash)))
+        return false;
+
+    std::string tmp_path = path + ".XXXXXX";
+    int fd = mkstemp(tmp_path.data());
+    if (fd == -1)
+        return false;
+    bool success = writen(fd, contents.data(), contents.size()) != -1;
+    auto saved_errno = errno;
+    close(fd);
+    if (success) {
+        if (rename(tmp_path.c_str(), path.c_str()) == 0)
+            return true;
+        saved_errno = errno;
+    }
+    unlink(tmp_path.c_str());
+    errno = saved_errno;
+    return false;
+}
+
+static uint64_t rotate_left(uint64_t value, int count) {
+    return (value << count) | (value >> (64 - count));
+}
+
+uint64_t hash_contents(std::string_view data) {
+    // This is modeled after XXH64. Four independent lanes consume 32 bytes per
+    // iteration, so that the multiplications can be pipelined.
+    constexpr uint64_t prime1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+    constexpr uint64_t prime3 = 0x165667B19E3779F9ull;
+
+    auto round = [](uint64_t acc, uint64_t input) {
+        return rotate_left(acc + input * prime2, 31) * prime1;
+    };
+    auto load = [](const char *ptr) {
+        uint64_t result;
+        memcpy(&result, ptr, sizeof result);
+        return result;
+    };
+
+    const char *ptr = data.data();
+    size_t size = data.size();
+    uint64_t hash = prime3 + (uint64_t)size;
+    if (size >= 32) {
+        uint64_t lanes[4] = {prime1 + prime2, prime2, 0, 0 - prime1};
+        for (; size >= 32; ptr += 32, size -= 32) {
+            for (int i = 0; i < 4; ++i)
+                lanes[i] = round(lanes[i], load(ptr + i * 8));
+        }
+        hash += rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7) +
+                rotate_left(lanes[2], 12) + rotate_left(lanes[3], 18);
+        for (uint64_t lane : lanes)
+            hash = (hash ^ round(0, lane)) * prime1 + prime3;
+    }
+    for (; size >= 8; ptr += 8, size -= 8)
+        hash = rotate_left(hash ^ round(0, load(ptr)), 27) * prime1 + prime3;
+    if (size > 0) {
+        // The length is already mixed in, so zero padding is unambiguous.
+        uint64_t tail = 0;
+        memcpy(&tail, ptr, size);
+        hash = rotate_left(hash ^ round(0, tail), 27) * prime1 + prime3;
+    }
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
 std::string get_variable(const std::string &var) {
     const char *env = std::getenv(var.c_str());
     if (env) {
@@ -22,6 +22,7 @@
 
 #include <cstdlib>
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string>
 #include <string_view>
@@ -43,9 +44,23 @@ std::string join(const stringlist_t &vec, char delimiter = ' ');
 bool have_equal_element(const stringlist_t &list1, const stringlist_t &list2);
 void replace(std::string &str, const std::string &substr,
              const std::string &substitute);
-bool endswith(const std::string &str, const std::string &suffix);
+bool endswith(std::string_view str, std::string_view suffix);
 bool startswith(std::string_view str, std::string_view prefix);
 bool is_directory(const std::string &path);
+// Create directory path including all missing parent directories (like mkdir
+// -p). Return false and set errno on failure.
+bool make_directories(const std::string &path);
+// Read the whole file into result. Return false and set errno on failure.
+bool read_file(const std::string &path, std::string &result);
+// Replace the contents of path atomically. The contents are written to a
+// temporary file which is then renamed to path, so concurrently running
+// processes never see a partially written file. Missing parent directories are
+// created. Return false and set errno on failure.
+bool write_file_atomically(const std::string &path, std::string_view contents);
+// Return a 64-bit hash of data. It is fast, but it isn't cryptographic, it
+// should be used only to detect accidental changes (like rewriting a file with
+// the same contents).
+uint64_t hash_contents(std::string_view data);
 std::string get_variable(const std::string &var);
 ssize_t readn(int fd, void *buffer, size_t n);
 ssize_t writen(int fd, const void *buffer, size_t n);
@@ -31,6 +31,7 @@
 #include <spdlog/spdlog.h>
 
 #include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <errno.h>
 #include <fcntl.h>
@@ -48,27 +49,34 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <system_error>
 #include <type_traits>
 #include <unistd.h>
-#include <unordered_set>
 #include <utility>
 #include <variant>
 #include <vector>
 
+#include "AppCache.hh"
 #include "AppManager.hh"
 #include "Application.hh"
 #include "CMDLineAssembler.hh"
 #include "CMDLineTerm.hh"
+#include "DesktopFileLoader.hh"
+#include "DesktopFileScanner.hh"
 #include "Dmenu.hh"
 #include "DynamicCompare.hh"
+#include "FlatHashMap.hh"
 #include "FieldCodes.hh"
-#include "FileFinder.hh"
 #include "Formatters.hh"
 #include "HistoryManager.hh"
 #include "I3Exec.hh"
 #include "LocaleSuffixes.hh"
+#include "MenuCache.hh"
 #include "NotifyBase.hh"
+#include "NotifyBatch.hh"
+#include "PageBuffer.hh"
 #include "SearchPath.hh"
+#include "ThreadPool.hh"
 #include "Utilities.hh"
 #include "version.hh"
 
@@ -78,6 +86,20 @@
 #include "NotifyInotify.hh"
 #endif
 
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// POSIX_SPAWN_SETSID and posix_spawn_file_actions_addchdir_np() are needed to
+// launch programs with posix_spawn() in wait-on mode. glibc has both since
+// 2.29. fork() is used elsewhere.
+#if defined(__GLIBC__) &&                                                      \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+#include <spawn.h>
+#define HAVE_POSIX_SPAWN_SESSION
+extern char **environ;
+#endif
+
 #ifdef FIX_COVERAGE
 extern "C" void __gcov_dump();
 
@@ -165,6 +187,22 @@ static void print_usage(FILE *f) {
         "environment\n"
         "    --wait-on=<path>\n"
         "        Enable daemon mode\n"
+        "    --wait-on-delay=<milliseconds>\n"
+        "        Wait this long for more changes of desktop files before "
+        "applying them\n"
+        "        in daemon mode (default 50)\n"
+        "    --wait-on-close-write\n"
+        "        Reload desktop files in daemon mode only after they have "
+        "been closed\n"
+        "        instead of after each write (inotify only)\n"
+        "    --use-cache\n"
+        "        Cache parsed desktop files in "
+        "$XDG_CACHE_HOME/j4-dmenu-desktop/\n"
+        "    --optimistic-menu\n"
+        "        Show the menu from the previous run before desktop files are "
+        "read\n"
+        "    --lazy-exec\n"
+        "        Parse Exec and Path keys only for the selected desktop file\n"
         "    --wrapper=<wrapper>\n"
         "        A wrapper binary.\n"
         "        Usage of '--wrapper \"i3 exec\"' and '--wrapper \"sway "
@@ -206,6 +244,9 @@ static void print_usage(FILE *f) {
         "inotify"
 #endif
         " support.\n"
+#ifdef USE_IO_URING
+        "io_uring support is enabled.\n"
+#endif
 #ifdef DEBUG
         "DEBUG enabled.\n"
 #endif
@@ -217,29 +258,17 @@ static void print_usage(FILE *f) {
  */
 namespace SetupPhase
 {
-// This returns absolute paths.
-static Desktop_file_list collect_files(const stringlist_t &search_path) {
-    Desktop_file_list result;
-    result.reserve(search_path.size());
-
-    for (const string &base_path : search_path) {
-        std::vector<string> found_desktop_files;
-        FileFinder finder(base_path);
-        while (++finder) {
-            if (finder.isdir() || !endswith(finder.path(), ".desktop"))
-                continue;
-            found_desktop_files.push_back(finder.path());
-        }
-        result.emplace_back(base_path, std::move(found_desktop_files));
-    }
-
-    return result;
+// This returns absolute paths. All directories in search path are scanned in
+// parallel, but the order of files in each rank is deterministic.
+static Desktop_file_list collect_files(const stringlist_t &search_path,
+                                       ThreadPool &pool) {
+    return scan_desktop_files(search_path, pool);
 }
 
 // This helper function is most likely useless, but I, meator, ran into
 // a situation where a directory was specified twice in $XDG_DATA_DIRS.
 static void validate_search_path(stringlist_t &search_path) {
-    std::unordered_set<std::string> is_unique;
+    FlatHashSet<std::string> is_unique;
     auto iter = search_path.begin();
     while (iter != search_path.end()) {
         const std::string &path = *iter;
@@ -286,41 +315,121 @@ public:
     void load(const AppManager &appm) {
         SPDLOG_INFO("Received request to load NameToAppMapping, formatting all "
                     "names...");
-        this->raw_mapping = appm.view_name_app_mapping();
+        this->appm = &appm;
 
         this->mapping.clear();
+        this->formatted_names.clear();
+
+        for (const auto &[key, resolved] : appm.view_name_app_mapping())
+            insert(key, resolved);
+    }
 
-        for (const auto &[key, resolved] : this->raw_mapping) {
-            const auto &[ptr, is_generic] = resolved;
-            if (this->exclude_generic && is_generic)
+    // Apply changes taken from AppManager passed to load(). Only the changed
+    // names are formatted.
+    void apply(const std::vector<AppManager::Name_change> &changes) {
+        SPDLOG_INFO("Applying {} name changes to NameToAppMapping...",
+                    changes.size());
+        // All old names are removed first. A new formatted name could
+        // otherwise collide with an old one which is about to be removed.
+        for (const AppManager::Name_change &change : changes) {
+            if (!change.previous)
                 continue;
-            std::string formatted = this->app_format(key, *ptr);
-            SPDLOG_DEBUG("Formatted '{}' -> '{}'", key, formatted);
-            auto safety_check = this->mapping.try_emplace(std::move(formatted),
-                                                          ptr, is_generic);
-            if (!safety_check.second) {
-                SPDLOG_ERROR("Formatter has created a collision!");
-                abort();
-            }
+            auto iter =
+                this->formatted_names.find(get_index_key(*change.previous));
+            if (iter == this->formatted_names.end())
+                continue; // The name is excluded.
+            this->mapping.erase(iter->second);
+            this->formatted_names.erase(iter);
+        }
+        for (const AppManager::Name_change &change : changes) {
+            if (change.current)
+                insert(change.name, *change.current);
         }
     }
 
+#ifdef DEBUG
+    // Check that the applied changes have the same result as load().
+    void check_inner_state() const {
+        NameToAppMapping reloaded(*this);
+        reloaded.load(*this->appm);
+        bool equal = std::equal(
+            this->mapping.begin(), this->mapping.end(),
+            reloaded.mapping.begin(), reloaded.mapping.end(),
+            [](const auto &a, const auto &b) {
+                return a.first == b.first &&
+                       a.second.handle == b.second.handle &&
+                       a.second.is_generic == b.second.is_generic;
+            });
+        if (!equal || this->formatted_names.size() != this->mapping.size()) {
+            SPDLOG_ERROR("NameToAppMapping is inconsistent with AppManager!");
+            abort();
+        }
+    }
+#endif
+
     const formatted_name_map &get_formatted_map() const {
         return this->mapping;
     }
 
     const raw_name_map &get_unordered_raw_map() const {
-        return this->raw_mapping;
+        return this->appm->view_name_app_mapping();
     }
 
     application_formatter view_formatter() const {
         return this->app_format;
     }
 
+    // Return the formatted name of resolved or nullptr if it's excluded.
+    const std::string *
+    get_formatted_name(const Resolved_application &resolved) const {
+        auto iter = this->formatted_names.find(get_index_key(resolved));
+        if (iter == this->formatted_names.end())
+            return nullptr;
+        return &iter->second->first;
+    }
+
+    // Handles in the mappings are valid until AppManager is modified and
+    // its changes are applied.
+    const Application &resolve(Application_handle handle) const {
+        const Application *app = this->appm->resolve(handle);
+        if (app == nullptr) {
+            SPDLOG_ERROR("NameToAppMapping is outdated!");
+            abort();
+        }
+        return *app;
+    }
+
 private:
+    // A row of AppManager provides at most one Name and one GenericName, so
+    // the handle and is_generic identify the name. Rows are limited to 2^31,
+    // otherwise AppManager would need 2^31 desktop files.
+    static uint64_t get_index_key(const Resolved_application &resolved) {
+        return (uint64_t)resolved.handle.slot << 33 |
+               (uint64_t)resolved.handle.generation << 1 | resolved.is_generic;
+    }
+
+    void insert(string_view name, const Resolved_application &resolved) {
+        if (this->exclude_generic && resolved.is_generic)
+            return;
+        std::string formatted =
+            this->app_format(name, resolve(resolved.handle));
+        SPDLOG_DEBUG("Formatted '{}' -> '{}'", name, formatted);
+        auto safety_check = this->mapping.try_emplace(std::move(formatted),
+                                                      resolved.handle,
+                                                      resolved.is_generic);
+        if (!safety_check.second) {
+            SPDLOG_ERROR("Formatter has created a collision!");
+            abort();
+        }
+        this->formatted_names.try_emplace(get_index_key(resolved),
+                                          safety_check.first);
+    }
+
+    const AppManager *appm = nullptr;
     application_formatter app_format;
     formatted_name_map mapping;
-    raw_name_map raw_mapping;
+    // Entries of mapping indexed by the Application they refer to.
+    FlatHashMap<uint64_t, formatted_name_map::iterator> formatted_names;
     bool exclude_generic;
 };
 
@@ -331,43 +440,63 @@ static_assert(std::is_move_constructible_v<NameToAppMapping>);
 class FormattedHistoryManager
 {
 public:
-    void reload(const NameToAppMapping &mapping) {
+    // Obsolete history entries are reported only if log_obsolete_entries is
+    // set. Names are taken from mapping, they aren't formatted again.
+    void reload(const NameToAppMapping &mapping,
+                bool log_obsolete_entries = true) {
         const auto &raw_name_lookup = mapping.get_unordered_raw_map();
 
         this->formatted_history.clear();
+        this->raw_names.clear();
         const auto &hist_view = this->hist.view();
         this->formatted_history.reserve(hist_view.size());
 
-        const auto &format = mapping.view_formatter();
-
         for (auto iter = hist_view.begin(); iter != hist_view.end(); ++iter) {
             const std::string &raw_name = iter->second;
 
             auto lookup_result = raw_name_lookup.find(raw_name);
             if (lookup_result == raw_name_lookup.end()) {
                 if (this->remove_obsolete_entries) {
-                    SPDLOG_WARN(
-                        "Removing history entry '{}', which doesn't correspond "
-                        "to any known desktop app name.",
-                        raw_name);
+                    if (log_obsolete_entries)
+                        SPDLOG_WARN("Removing history entry '{}', which "
+                                    "doesn't correspond to any known desktop "
+                                    "app name.",
+                                    raw_name);
                     iter = this->hist.remove_obsolete_entry(iter);
                     if (iter == hist_view.end())
                         break;
                 } else {
-                    SPDLOG_WARN(
-                        "Couldn't find history entry '{}'. Has the program "
-                        "been uninstalled? Has j4-dmenu-desktop been executed "
-                        "with different $XDG_DATA_HOME or $XDG_DATA_DIRS? Use "
-                        "--prune-bad-usage-log-entries "
-                        "to remove these entries.",
-                        raw_name);
+                    if (log_obsolete_entries)
+                        SPDLOG_WARN(
+                            "Couldn't find history entry '{}'. Has the "
+                            "program been uninstalled? Has j4-dmenu-desktop "
+                            "been executed with different $XDG_DATA_HOME or "
+                            "$XDG_DATA_DIRS? Use "
+                            "--prune-bad-usage-log-entries "
+                            "to remove these entries.",
+                            raw_name);
+                    // The name might reappear.
+                    this->raw_names.insert(raw_name);
                 }
                 continue;
             }
+            this->raw_names.insert(raw_name);
             if (this->exclude_generic && lookup_result->second.is_generic)
                 continue;
             this->formatted_history.push_back(
-                format(raw_name, *lookup_result->second.app));
+                *mapping.get_formatted_name(lookup_result->second));
+        }
+    }
+
+    // mapping must have the changes applied already. The history is reloaded
+    // only if one of the changed names is in it.
+    void apply(const NameToAppMapping &mapping,
+               const std::vector<AppManager::Name_change> &changes) {
+        for (const AppManager::Name_change &change : changes) {
+            if (this->raw_names.count(change.name)) {
+                reload(mapping);
+                return;
+            }
         }
     }
 
@@ -382,7 +511,7 @@ public:
 
     const stringlist_t &view() const {
 #ifdef DEBUG
-        std::unordered_set<string_view> ensure_uniqueness;
+        FlatHashSet<string_view> ensure_uniqueness;
         for (const std::string &hist_entry : this->formatted_history) {
             if (!ensure_uniqueness.emplace(hist_entry).second) {
                 SPDLOG_ERROR(
@@ -396,8 +525,10 @@ public:
         return this->formatted_history;
     }
 
-    void increment(const string &name) {
+    // The formatted history is reordered to reflect the new usage counts.
+    void increment(const string &name, const NameToAppMapping &mapping) {
         this->hist.increment(name);
+        reload(mapping, false);
     }
 
     void remove_obsolete_entry(
@@ -408,6 +539,9 @@ public:
 private:
     HistoryManager hist;
     stringlist_t formatted_history;
+    // Raw names in hist (except the removed obsolete ones). A change of any of
+    // them requires reload().
+    FlatHashSet<std::string> raw_names;
     bool remove_obsolete_entries;
     bool exclude_generic;
 };
@@ -446,12 +580,10 @@ public:
     }
 };
 
-static std::optional<std::string>
-do_dmenu(Dmenu &dmenu, const name_map &mapping, const stringlist_t &history) {
-    // Check for dmenu errors via SIGPIPE.
-    SIGPIPEHandler sig;
-
-    // Transfer the names to dmenu
+// Call f for each name in the order in which it should be shown in dmenu.
+template <typename F>
+static void for_each_menu_name(const name_map &mapping,
+                               const stringlist_t &history, F &&f) {
     if (!history.empty()) {
         std::set<std::string_view, DynamicCompare> desktop_file_names(
             mapping.key_comp());
@@ -466,7 +598,7 @@ do_dmenu(Dmenu &dmenu, const name_map &mapping, const stringlist_t &history) {
             // has been removed, making the history entry obsolete. The
             // history entry shouldn't be shown if that is the case.
             if (desktop_file_names.erase(name))
-                dmenu.write(name);
+                f(std::string_view(name));
             else {
                 // This shouldn't happen thanks to FormattedHistoryManager
                 SPDLOG_ERROR(
@@ -476,34 +608,73 @@ do_dmenu(Dmenu &dmenu, const name_map &mapping, const stringlist_t &history) {
             }
         }
         for (const auto &name : desktop_file_names)
-            dmenu.write(name);
+            f(name);
     } else {
         for (const auto &[name, ignored] : mapping)
-            dmenu.write(name);
+            f(std::string_view(name));
     }
+}
+
+// This stores the names written to dmenu to result. They are saved by
+// MenuCache and they are kept by CommandRetrievalLoop between invocations in
+// wait-on mode.
+static void build_menu_payload(const name_map &mapping,
+                               const stringlist_t &history,
+                               PageBuffer &result) {
+    // Each name is written exactly once, so the size is known beforehand.
+    size_t size = 0;
+    for (const auto &[name, ignored] : mapping)
+        size += name.size() + 1;
+    char *pos = result.reset(size);
+    for_each_menu_name(mapping, history, [&pos](std::string_view name) {
+        memcpy(pos, name.data(), name.size());
+        pos += name.size();
+        *pos++ = '\n';
+    });
+}
 
+// Collect the choices after the whole output of dmenu has been read.
+static std::vector<std::string> take_dmenu_choices(Dmenu &dmenu) {
+    std::vector<std::string> choices = dmenu.finish();
+    for (const std::string &choice : choices) {
+        fmt::print(stderr, "User input is: {}\n", choice);
+        SPDLOG_INFO("User input is: {}", choice);
+    }
+    return choices;
+}
+
+static void show_dmenu(Dmenu &dmenu, std::string_view payload) {
+    // Check for dmenu errors via SIGPIPE.
+    SIGPIPEHandler sig;
+
+    dmenu.splice_payload(payload);
     dmenu.display();
+}
+
+// Write the names straight from the mapping. Names are batched into writev()
+// calls by Dmenu, no payload is built.
+static void show_dmenu(Dmenu &dmenu, const name_map &mapping,
+                       const stringlist_t &history) {
+    SIGPIPEHandler sig;
 
-    string choice = dmenu.read_choice(); // This blocks
-    if (choice.empty())
-        return {};
-    fmt::print(stderr, "User input is: {}\n", choice);
-    SPDLOG_INFO("User input is: {}", choice);
-    return choice;
+    for_each_menu_name(mapping, history,
+                       [&dmenu](std::string_view name) { dmenu.write(name); });
+    dmenu.display();
 }
 
 namespace Lookup
 {
 struct ApplicationLookup
 {
-    const Application *app;
+    Application_handle handle;
     bool is_generic;
     std::string args;
 
-    ApplicationLookup(const Application *a, bool i) : app(a), is_generic(i) {}
+    ApplicationLookup(Application_handle h, bool i)
+        : handle(h), is_generic(i) {}
 
-    ApplicationLookup(const Application *a, bool i, std::string arg)
-        : app(a), is_generic(i), args(std::move(arg)) {}
+    ApplicationLookup(Application_handle h, bool i, std::string arg)
+        : handle(h), is_generic(i), args(std::move(arg)) {}
 };
 
 struct CommandLookup
@@ -515,19 +686,19 @@ struct CommandLookup
 
 using lookup_res_type = std::variant<ApplicationLookup, CommandLookup>;
 
-// This function takes a query and returns Application*. If the optional is
-// empty, there is no desktop file with matching name. J4dd supports executing
-// raw commands through dmenu. This is the fallback behavior when there's no
-// match.
+// This function takes a query and returns a handle to the Application. If the
+// optional is empty, there is no desktop file with matching name. J4dd supports
+// executing raw commands through dmenu. This is the fallback behavior when
+// there's no match.
 static lookup_res_type lookup_name(const std::string &query,
                                    const name_map &map) {
     auto find = map.find(query);
     if (find != map.end())
-        return ApplicationLookup(find->second.app, find->second.is_generic);
+        return ApplicationLookup(find->second.handle, find->second.is_generic);
     else {
         for (const auto &[name, resolved] : map) {
             if (startswith(query, name))
-                return ApplicationLookup(resolved.app, resolved.is_generic,
+                return ApplicationLookup(resolved.handle, resolved.is_generic,
                                          query.substr(name.size()));
         }
         return CommandLookup(query);
@@ -541,9 +712,10 @@ public:
     CommandRetrievalLoop(
         Dmenu dmenu, SetupPhase::NameToAppMapping mapping,
         std::optional<SetupPhase::FormattedHistoryManager> hist_manager,
-        bool no_exec)
+        bool no_exec, std::optional<std::string> displayed_payload = {})
         : dmenu(std::move(dmenu)), mapping(std::move(mapping)),
-          hist_manager(std::move(hist_manager)), no_exec(no_exec) {}
+          hist_manager(std::move(hist_manager)), no_exec(no_exec),
+          displayed_payload(std::move(displayed_payload)) {}
 
     // This class could be copied or moved, but it wouldn't make much sense in
     // current implementation. This prevents accidental copy/move.
@@ -554,9 +726,12 @@ public:
 
     struct DesktopCommandInfo
     {
+        // This is valid until AppManager is modified.
         const Application *app;
         std::string args; // Arguments provided to %f, %F, %u and %U field codes
                           // in desktop files. This will be empty in most cases.
+        // This owns app if it has been loaded by load_lazy_values().
+        std::shared_ptr<const Application> full_app;
 
         DesktopCommandInfo(const Application *app, std::string args)
             : app(app), args(std::move(args)) {}
@@ -583,20 +758,118 @@ public:
         this->dmenu.run();
     }
 
-    std::optional<CommandInfoVariant> prompt_user_for_choice() {
-        std::optional<std::string> query =
-            RunPhase::do_dmenu(this->dmenu, this->mapping.get_formatted_map(),
-                               (this->hist_manager ? this->hist_manager->view()
-                                                   : stringlist_t{})); // blocks
-        if (!query) {
+    // Show the menu in dmenu (which has been started by run_dmenu() or in
+    // main()). The whole output of dmenu must then be read with
+    // read_dmenu_output() and the selected commands are returned by
+    // take_choices(). prompt_user_for_choice() does all of this at once,
+    // do_wait_on() reads the output in its poll() loop.
+    void show_menu() {
+        // Dmenu has already been fed with a cached payload (see
+        // --optimistic-menu in main()).
+        if (this->displayed_payload)
+            return;
+        RunPhase::show_dmenu(this->dmenu, get_menu_payload());
+        this->is_payload_in_flight = true;
+    }
+
+    int dmenu_output_fd() const {
+        return this->dmenu.output_fd();
+    }
+
+    // Return true once the whole output of dmenu has been read.
+    bool read_dmenu_output() {
+        return this->dmenu.read_output();
+    }
+
+    // Launchers supporting multiple selection can return several choices.
+    std::vector<CommandInfoVariant> take_choices() {
+        // The payload is relevant only to the first prompt.
+        std::optional<std::string> displayed_payload =
+            std::exchange(this->displayed_payload, std::nullopt);
+        std::vector<std::string> queries =
+            RunPhase::take_dmenu_choices(this->dmenu);
+        // Dmenu has exited, the pipe no longer refers to the payload.
+        this->is_payload_in_flight = false;
+        if (queries.empty()) {
             SPDLOG_INFO("No application has been selected, exiting...");
             return {};
         }
 
+        std::vector<CommandInfoVariant> result;
+        for (const std::string &query : queries) {
+            std::optional<CommandInfoVariant> command =
+                lookup_choice(query, displayed_payload);
+            if (command)
+                result.push_back(std::move(*command));
+        }
+        return result;
+    }
+
+    // The menu is shown only once here, so it isn't worth keeping its
+    // payload. Names are written to dmenu directly.
+    std::vector<CommandInfoVariant> prompt_user_for_choice() {
+        if (!this->displayed_payload) {
+            static const stringlist_t no_history;
+            RunPhase::show_dmenu(
+                this->dmenu, this->mapping.get_formatted_map(),
+                this->hist_manager ? this->hist_manager->view() : no_history);
+        }
+        while (!read_dmenu_output()) // blocks
+            ;
+        return take_choices();
+    }
+
+    // Apply changes taken from AppManager the mapping has been loaded from.
+    void
+    update_mapping(const std::vector<AppManager::Name_change> &changes) {
+        if (changes.empty())
+            return;
+        this->is_payload_valid = false;
+        this->mapping.apply(changes);
+#ifdef DEBUG
+        this->mapping.check_inner_state();
+#endif
+        if (this->hist_manager)
+            this->hist_manager->apply(this->mapping, changes);
+    }
+
+    // Return what will be written to dmenu by the next show_menu(). The
+    // payload is built only when the mapping or the history has changed
+    // since the last call, so showing the menu costs a single write in
+    // wait-on mode.
+    //
+    // The pages of the payload shown in dmenu are referred to by the pipe
+    // (see Dmenu::splice_payload()), so they mustn't be modified until dmenu
+    // exits. A single buffer is enough, the mapping and the history change
+    // only after take_choices() (do_wait_on() doesn't apply changes while
+    // dmenu is shown).
+    std::string_view get_menu_payload() {
+        if (!this->is_payload_valid) {
+#ifdef DEBUG
+            if (this->is_payload_in_flight) {
+                SPDLOG_ERROR("The menu payload has been rebuilt while it is "
+                             "shown in dmenu!");
+                abort();
+            }
+#endif
+            RunPhase::build_menu_payload(
+                this->mapping.get_formatted_map(),
+                (this->hist_manager ? this->hist_manager->view()
+                                    : stringlist_t{}),
+                this->payload_buffer);
+            this->is_payload_valid = true;
+        }
+        return this->payload_buffer.view();
+    }
+
+private:
+    std::optional<CommandInfoVariant>
+    lookup_choice(const std::string &query,
+                  const std::optional<std::string> &displayed_payload) {
         using namespace Lookup;
 
         lookup_res_type lookup =
-            lookup_name(*query, this->mapping.get_formatted_map());
+            lookup_name(query, this->mapping.get_formatted_map());
         bool is_custom = std::holds_alternative<CommandLookup>(lookup);
 
         if (is_custom)
@@ -604,34 +877,96 @@ public:
         else
             SPDLOG_DEBUG("Selected entry is: desktop app");
 
+        // The cached payload could have contained a name whose desktop file
+        // has been removed since. It mustn't be executed as a custom command.
+        if (is_custom && displayed_payload &&
+            MenuCache::payload_contains(*displayed_payload, query)) {
+            SPDLOG_WARN("Selected entry '{}' is no longer available, its "
+                        "desktop file has been removed.",
+                        query);
+            return {};
+        }
+
         if (is_custom)
             return CommandInfoVariant(std::in_place_type_t<CustomCommandInfo>{},
                                       std::get<CommandLookup>(lookup).command);
         else {
             const ApplicationLookup &appl = std::get<ApplicationLookup>(lookup);
+            const Application &app = this->mapping.resolve(appl.handle);
             if (!this->no_exec && this->hist_manager) {
-                const std::string &name =
-                    (appl.is_generic ? appl.app->generic_name : appl.app->name);
-                this->hist_manager->increment(name);
+                const std::string name(appl.is_generic ? app.generic_name
+                                                       : app.name);
+                this->hist_manager->increment(name, this->mapping);
+                // The order of names has changed.
+                this->is_payload_valid = false;
             }
             return CommandInfoVariant(
-                std::in_place_type_t<DesktopCommandInfo>{}, appl.app,
-                appl.args);
+                std::in_place_type_t<DesktopCommandInfo>{}, &app, appl.args);
         }
     }
 
-    void update_mapping(const AppManager &appm) {
-        this->mapping.load(appm);
-        if (this->hist_manager)
-            this->hist_manager->reload(this->mapping);
-    }
-
-private:
     Dmenu dmenu;
     SetupPhase::NameToAppMapping mapping;
     std::optional<SetupPhase::FormattedHistoryManager> hist_manager;
     bool no_exec;
+    // This is set when dmenu has already been shown with a cached payload.
+    std::optional<std::string> displayed_payload;
+    // See get_menu_payload().
+    PageBuffer payload_buffer;
+    bool is_payload_valid = false;
+    // This is set while dmenu is shown with payload_buffer.
+    bool is_payload_in_flight = false;
 };
+
+// Load the Exec and Path keys of the selected desktop file if they have been
+// skipped (see --lazy-exec). Return false if the desktop file can't be
+// executed anymore.
+bool load_lazy_values(const AppManager &appm,
+                      CommandRetrievalLoop::CommandInfoVariant &command_info) {
+    auto *info =
+        std::get_if<CommandRetrievalLoop::DesktopCommandInfo>(&command_info);
+    if (info == nullptr || !info->app->has_lazy_values())
+        return true;
+
+    SPDLOG_DEBUG("Loading Exec and Path of '{}'.", info->app->location);
+    Application::ParseResult result = appm.load_lazy_values(*info->app);
+    switch (result.state) {
+    case Application::ParseState::parsed:
+        info->full_app =
+            std::make_shared<const Application>(std::move(*result.app));
+        info->app = info->full_app.get();
+        return true;
+    case Application::ParseState::disabled:
+        SPDLOG_ERROR("Selected desktop file '{}' has been disabled.",
+                     info->app->location);
+        return false;
+    case Application::ParseState::invalid:
+        if (!result.key_error.empty())
+            SPDLOG_ERROR("{}: {}", info->app->location, result.key_error);
+        SPDLOG_ERROR("Selected desktop file '{}' is invalid: {}",
+                     info->app->location, result.reason);
+        return false;
+    case Application::ParseState::unreadable:
+        SPDLOG_ERROR("Couldn't read selected desktop file '{}': {}",
+                     info->app->location,
+                     std::system_category().message(result.error));
+        return false;
+    }
+    abort();
+}
+
+// Remove the commands whose desktop files can't be executed anymore (see
+// above). Return false if no command remains.
+bool load_lazy_values(
+    const AppManager &appm,
+    std::vector<CommandRetrievalLoop::CommandInfoVariant> &commands) {
+    commands.erase(std::remove_if(commands.begin(), commands.end(),
+                                  [&appm](auto &command) {
+                                      return !load_lazy_values(appm, command);
+                                  }),
+                   commands.end());
+    return !commands.empty();
+}
 }; // namespace RunPhase
 
 namespace ExecutePhase
@@ -658,6 +993,14 @@ public:
     virtual void
     execute(const RunPhase::CommandRetrievalLoop::CommandInfoVariant &) = 0;
 
+    // Execute all commands selected in dmenu. commands mustn't be empty.
+    virtual void execute_all(
+        const std::vector<RunPhase::CommandRetrievalLoop::CommandInfoVariant>
+            &commands) {
+        for (const auto &command : commands)
+            execute(command);
+    }
+
     virtual ~BaseExecutable() {}
 };
 
@@ -709,12 +1052,12 @@ public:
                 throw Exec_invalid_escape(
                     (std::string) "Error while processing selected desktop "
                                   "file '" +
-                    info.app->location + "': " + e.what());
+                    (std::string)info.app->location + "': " + e.what());
             }
             expand_field_codes(command_array, *info.app, info.args);
             if (info.app->terminal)
-                command_array =
-                    term_assembler(command_array, terminal, info.app->name);
+                command_array = term_assembler(command_array, terminal,
+                                               (std::string)info.app->name);
         }
 
         if (!wrapper.empty())
@@ -729,12 +1072,13 @@ public:
         if (std::holds_alternative<
                 RunPhase::CommandRetrievalLoop::DesktopCommandInfo>(
                 command_info)) {
-            const std::string &path =
+            // Path is NUL terminated.
+            std::string_view path =
                 std::get<RunPhase::CommandRetrievalLoop::DesktopCommandInfo>(
                     command_info)
                     .app->path;
             if (!path.empty()) {
-                if (chdir(path.c_str()) == -1) {
+                if (chdir(path.data()) == -1) {
                     SPDLOG_ERROR("Couldn't chdir() to '{}' set in Path key: {}",
                                  path, strerror(errno));
                     exit(EXIT_FAILURE);
@@ -748,6 +1092,104 @@ public:
         abort();
     }
 
+    // A single command replaces j4-dmenu-desktop like execute(). Several
+    // commands are launched in child processes.
+    void execute_all(
+        const std::vector<RunPhase::CommandRetrievalLoop::CommandInfoVariant>
+            &commands) override {
+        if (commands.size() == 1)
+            execute(commands.front());
+        for (const auto &command : commands)
+            spawn(command);
+    }
+
+    // Execute the command in a new session in a child process and return its
+    // PID or -1 on failure. This is used in wait-on mode, where
+    // j4-dmenu-desktop must keep running.
+    pid_t spawn(const RunPhase::CommandRetrievalLoop::CommandInfoVariant
+                    &command_info) {
+#ifdef HAVE_POSIX_SPAWN_SESSION
+        // posix_spawn() doesn't copy the page tables of j4-dmenu-desktop,
+        // which holds all desktop files in wait-on mode. This makes launching
+        // faster.
+        stringlist_t args;
+        try {
+            args = prepare_processed_argv(
+                command_info, this->wrapper, this->terminal,
+                this->term_assembler, this->wine_compatibility_mode);
+        } catch (const CMDLineTerm::initialization_error &e) {
+            SPDLOG_ERROR(
+                "Couldn't set up temporary script for terminal emulator: {}",
+                e.what());
+            return -1;
+        } catch (const CMDLineAssembly::Exec_invalid_escape &e) {
+            SPDLOG_ERROR("{}", e.what());
+            return -1;
+        }
+        std::string cmdline_string =
+            CMDLineAssembly::convert_argv_to_string(args);
+        SPDLOG_INFO("Executing command: {}", cmdline_string);
+
+        posix_spawnattr_t attr;
+        posix_spawnattr_init(&attr);
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        OnExit destroy_spawn_state = [&attr, &actions]() {
+            posix_spawn_file_actions_destroy(&actions);
+            posix_spawnattr_destroy(&attr);
+        };
+
+        int error = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID);
+        if (error != 0) {
+            SPDLOG_ERROR("Couldn't set up a new session for command: {}: {}",
+                         cmdline_string, strerror(error));
+            return -1;
+        }
+        using RunPhase::CommandRetrievalLoop;
+        if (const auto *info =
+                std::get_if<CommandRetrievalLoop::DesktopCommandInfo>(
+                    &command_info)) {
+            // Path is NUL terminated.
+            if (!info->app->path.empty()) {
+                error = posix_spawn_file_actions_addchdir_np(
+                    &actions, info->app->path.data());
+                if (error != 0) {
+                    SPDLOG_ERROR("Couldn't change directory to '{}' for "
+                                 "command: {}: {}",
+                                 info->app->path, cmdline_string,
+                                 strerror(error));
+                    return -1;
+                }
+            }
+        }
+
+        auto argv = CMDLineAssembly::create_argv(args);
+        pid_t pid;
+        error = posix_spawnp(&pid, argv.front(), &actions, &attr,
+                             (char *const *)argv.data(), environ);
+        if (error != 0) {
+            SPDLOG_ERROR("Couldn't execute command: {}: {}", cmdline_string,
+                         strerror(error));
+            return -1;
+        }
+        return pid;
+#else
+        pid_t pid = fork();
+        switch (pid) {
+        case -1:
+            perror("fork");
+            exit(EXIT_FAILURE);
+        case 0:
+            setsid();
+            // This function can throw. It means that the child process can
+            // jump out to main.
+            execute(command_info);
+            abort();
+        }
+        return pid;
+#endif
+    }
+
 private:
     std::string terminal;
     std::string wrapper; // empty when no wrapper is in use
@@ -834,7 +1276,7 @@ public:
                 throw Exec_invalid_escape(
                     (std::string) "Error while processing selected desktop "
                                   "file '" +
-                    info.app->location + "': " + e.what());
+                    (std::string)info.app->location + "': " + e.what());
             }
             expand_field_codes(command_array, *info.app, info.args);
             if (!info.app->path.empty()) {
@@ -845,7 +1287,8 @@ public:
                     std::vector<std::string> new_command_array =
                         CMDLineAssembly::wrap_cmdstring_in_shell(result);
                     new_command_array = this->term_assembler(
-                        new_command_array, this->terminal, info.app->name);
+                        new_command_array, this->terminal,
+                        (std::string)info.app->name);
                     result = CMDLineAssembly::convert_argv_to_string(
                         new_command_array);
                 }
@@ -853,7 +1296,7 @@ public:
                 if (info.app->terminal) {
                     std::vector<std::string> new_command_array =
                         this->term_assembler(command_array, this->terminal,
-                                             info.app->name);
+                                             (std::string)info.app->name);
                     result = CMDLineAssembly::convert_argv_to_string(
                         new_command_array);
                 } else
@@ -881,11 +1324,13 @@ private:
 do_wait_on(NotifyBase &notify, const char *wait_on, AppManager &appm,
            const stringlist_t &search_path,
            RunPhase::CommandRetrievalLoop &command_retrieve,
-           ExecutePhase::BaseExecutable *executor) {
+           ExecutePhase::BaseExecutable *executor,
+           std::chrono::milliseconds notify_delay) {
     // We need to determine if we're i3 to know if we need to fork before
     // executing a program.
-    bool is_i3 =
-        dynamic_cast<ExecutePhase::NormalExecutable *>(executor) == nullptr;
+    auto *normal_executor =
+        dynamic_cast<ExecutePhase::NormalExecutable *>(executor);
+    bool is_i3 = normal_executor == nullptr;
 
     int local_sigchld_fd = -1;
 
@@ -904,42 +1349,86 @@ do_wait_on(NotifyBase &notify, const char *wait_on, AppManager &appm,
     pollfd watch[] = {
         {fd,               POLLIN, 0},
         {notify.getfd(),   POLLIN, 0},
-        {local_sigchld_fd, POLLIN, 0}
+        {local_sigchld_fd, POLLIN, 0},
+        {-1,               POLLIN, 0}
     };
-    // Do not process the third entry when in i3 mode
+    // The third entry is ignored when in i3 mode.
     // i3 mode doesn't exec nor fork, so the entire SIGCHLD handling mechanism
     // is turned off for it. The signal handler is not established and poll
-    // disregards it because of nfds (local_sigchld_fd is also set to -1, so
-    // poll() would have ignored it anyway).
-    int nfds = is_i3 ? 2 : 3;
+    // disregards local_sigchld_fd because it is set to -1.
+    // The fourth entry is the output of dmenu. It is set only while dmenu is
+    // shown.
+    int nfds = 4;
+
+    // Desktop files are usually modified in bulk (by package managers).
+    // Changes are collected and applied at once to update the mapping only
+    // once.
+    NotifyBatch batch(notify_delay);
+    auto apply_changes = [&]() {
+        std::vector<NotifyBase::FileChange> changes = batch.take();
+        SPDLOG_INFO("Applying {} desktop file changes...", changes.size());
+        for (const auto &i : changes) {
+            if (!endswith(i.name, ".desktop"))
+                continue;
+            switch (i.status) {
+            case NotifyBase::changetype::modified:
+                appm.add(search_path[i.rank] + i.name, search_path[i.rank],
+                         i.rank);
+                break;
+            case NotifyBase::changetype::deleted:
+                appm.remove(search_path[i.rank] + i.name, search_path[i.rank]);
+                break;
+            default:
+                // Shouldn't be reachable.
+                abort();
+            }
+        }
+        command_retrieve.update_mapping(appm.take_name_changes());
+#ifdef DEBUG
+        appm.check_inner_state();
+#endif
+    };
+
+    auto launch =
+        [&](std::vector<RunPhase::CommandRetrievalLoop::CommandInfoVariant>
+                commands) {
+            if (commands.empty() || !RunPhase::load_lazy_values(appm, commands))
+                return;
+            if (is_i3) {
+                executor->execute_all(commands);
+                return;
+            }
+            for (const auto &command : commands) {
+                pid_t pid = normal_executor->spawn(command);
+                if (pid != -1)
+                    processes_to_wait_for.push_back(pid);
+            }
+        };
+
     while (1) {
-        watch[0].revents = watch[1].revents = watch[2].revents = 0;
+        for (pollfd &entry : watch)
+            entry.revents = 0;
+        // The choice is looked up in the mapping shown in dmenu, so changes
+        // aren't applied while dmenu is shown.
+        bool dmenu_shown = watch[3].fd != -1;
+        int timeout =
+            dmenu_shown ? -1 : batch.get_timeout(NotifyBatch::clock::now());
         int ret;
-        while ((ret = poll(watch, nfds, -1)) == -1 && errno == EINTR)
+        while ((ret = poll(watch, nfds, timeout)) == -1 && errno == EINTR)
             ;
         if (ret == -1)
             PFATALE("poll");
-        if (watch[1].revents & POLLIN) {
-            for (const auto &i : notify.getchanges()) {
-                if (!endswith(i.name, ".desktop"))
-                    continue;
-                switch (i.status) {
-                case NotifyBase::changetype::modified:
-                    appm.add(search_path[i.rank] + i.name, search_path[i.rank],
-                             i.rank);
-                    break;
-                case NotifyBase::changetype::deleted:
-                    appm.remove(search_path[i.rank] + i.name,
-                                search_path[i.rank]);
-                    break;
-                default:
-                    // Shouldn't be reachable.
-                    abort();
-                }
-                command_retrieve.update_mapping(appm);
-#ifdef DEBUG
-                appm.check_inner_state();
-#endif
+        if (watch[1].revents & POLLIN)
+            batch.add(notify.getchanges(), NotifyBatch::clock::now());
+        if (!dmenu_shown && batch.is_due(NotifyBatch::clock::now()))
+            apply_changes();
+        if (watch[3].revents & (POLLIN | POLLHUP)) {
+            // The output is read as it arrives, dmenu could block on a full
+            // pipe otherwise.
+            if (command_retrieve.read_dmenu_output()) {
+                watch[3].fd = -1;
+                watch[0].fd = fd;
+                launch(command_retrieve.take_choices());
             }
         }
         if (watch[0].revents & POLLIN) {
@@ -974,29 +1463,17 @@ do_wait_on(NotifyBase &notify, const char *wait_on, AppManager &appm,
             if (data == 'q')
                 exit(EXIT_SUCCESS);
 
-            command_retrieve.run_dmenu();
+            // The menu must reflect all changes which have been made so far.
+            if (!batch.empty())
+                apply_changes();
 
-            auto user_response = command_retrieve.prompt_user_for_choice();
-            if (user_response) {
-                if (is_i3)
-                    executor->execute(*user_response);
-                else {
-                    pid_t pid = fork();
-                    switch (pid) {
-                    case -1:
-                        perror("fork");
-                        exit(EXIT_FAILURE);
-                    case 0:
-                        close(fd);
-                        setsid();
-                        // This function can throw. It means that the child
-                        // process can jump out to main.
-                        executor->execute(*user_response);
-                        abort();
-                    }
-                    processes_to_wait_for.push_back(pid);
-                }
-            }
+            command_retrieve.run_dmenu();
+            command_retrieve.show_menu();
+            watch[3].fd = command_retrieve.dmenu_output_fd();
+            // Invocations received while dmenu is shown are handled after it
+            // exits. The FIFO isn't polled at all until then, POLLHUP can't be
+            // masked and its handler below would discard the pending data.
+            watch[0].fd = -1;
         }
         if (watch[0].revents & POLLHUP) {
             // The writing client has closed. We won't be able to poll()
@@ -1054,6 +1531,8 @@ do_wait_on(NotifyBase &notify, const char *wait_on, AppManager &appm,
  * 2) start dmenu if not in wait_on mode
  *    It's good to start it early, because the user could have specified the
  *    -f flag to dmenu
+ *    If --optimistic-menu is used, the menu from the previous run is shown
+ *    right away.
  * 3) collect absolute pathnames of all desktop files
  * 4) construct AppManager (which will load these in)
  * 5) initialize history
@@ -1100,6 +1579,9 @@ int main(int argc, char **argv) {
     std::string terminal;
     std::string wrapper;
     const char *wait_on = nullptr;
+    // Milliseconds.
+    int wait_on_delay = 50;
+    bool wait_on_close_write = false;
 
     bool use_xdg_de = false;
     bool exclude_generic = false;
@@ -1111,6 +1593,9 @@ int main(int argc, char **argv) {
     bool skip_i3_check = false;
     bool prune_bad_usage_log_entries = false;
     bool wine_compatibility_mode = true;
+    bool use_cache = false;
+    bool optimistic_menu = false;
+    bool lazy_exec = false;
 
     // This variable doesn't have much use, wine_compatibility_mode is more
     // important. It is only used to detect if both mutaly exclusive flags have
@@ -1122,6 +1607,8 @@ int main(int argc, char **argv) {
     bool loglevel_overridden = false;
 
     application_formatter appformatter = appformatter_default;
+    // This is used only to identify the formatter in MenuCache's key.
+    const char *appformatter_name = "default";
 
     CMDLineTerm::term_assembler term_mode = CMDLineTerm::default_term_assembler;
 
@@ -1141,6 +1628,10 @@ int main(int argc, char **argv) {
             {"usage-log",                   required_argument, 0, 'l'},
             {"prune-bad-usage-log-entries", no_argument,       0, 'p'},
             {"wait-on",                     required_argument, 0, 'w'},
+            {"wait-on-delay",               required_argument, 0, 'y'},
+            {"wait-on-close-write",         no_argument,       0, 'Z'},
+            {"use-cache",                   no_argument,       0, 'c'},
+            {"optimistic-menu",             no_argument,       0, 'M'},
             {"no-exec",                     no_argument,       0, 'e'},
             {"wrapper",                     required_argument, 0, 'W'},
             {"case-insensitive",            no_argument,       0, 'i'},
@@ -1152,6 +1643,7 @@ int main(int argc, char **argv) {
             {"desktop-file-quirks",         required_argument, 0, 'D'},
             {"strict-parsing",              no_argument,       0, 'R'},
             {"version",                     no_argument,       0, 'E'},
+            {"lazy-exec",                   no_argument,       0, 'L'},
             {0,                             0,                 0, 0  }
         };
 
@@ -1198,9 +1690,11 @@ int main(int argc, char **argv) {
             exit(EXIT_SUCCESS);
         case 'b':
             appformatter = appformatter_with_binary_name;
+            appformatter_name = "binary";
             break;
         case 'f':
             appformatter = appformatter_with_base_binary_name;
+            appformatter_name = "base-binary";
             break;
         case 'n':
             exclude_generic = true;
@@ -1214,6 +1708,31 @@ int main(int argc, char **argv) {
         case 'w':
             wait_on = optarg;
             break;
+        case 'y': {
+            char *end;
+            errno = 0;
+            long delay = strtol(optarg, &end, 10);
+            if (errno != 0 || end == optarg || *end != '\0' || delay < 0 ||
+                delay > 60000) {
+                fmt::print(stderr,
+                           "Invalid delay supplied to --wait-on-delay!\n");
+                exit(EXIT_FAILURE);
+            }
+            wait_on_delay = delay;
+            break;
+        }
+        case 'Z':
+            wait_on_close_write = true;
+            break;
+        case 'c':
+            use_cache = true;
+            break;
+        case 'M':
+            optimistic_menu = true;
+            break;
+        case 'L':
+            lazy_exec = true;
+            break;
         case 'e':
             no_exec = true;
             break;
@@ -1388,6 +1907,22 @@ int main(int argc, char **argv) {
         }
     }
 
+    if (optimistic_menu && wait_on) {
+        SPDLOG_WARN("--optimistic-menu has no effect in wait-on mode.");
+        optimistic_menu = false;
+    }
+
+#ifdef USE_KQUEUE
+    if (wait_on_close_write)
+        SPDLOG_WARN("--wait-on-close-write has no effect with kqueue.");
+#endif
+
+    if (lazy_exec && appformatter != appformatter_default) {
+        SPDLOG_WARN("--lazy-exec has no effect with --display-binary or "
+                    "--display-binary-base.");
+        lazy_exec = false;
+    }
+
     if (no_exec && use_i3_ipc)
         SPDLOG_WARN("I3 and noexec mode have been specified. I3 mode will be "
                     "ignored.");
@@ -1447,24 +1982,75 @@ int main(int argc, char **argv) {
 
     SetupPhase::validate_search_path(search_path);
 
+    LocaleSuffixes locales = LocaleSuffixes::from_environment();
+    {
+        auto suffixes = locales.list_suffixes_for_logging_only();
+        SPDLOG_DEBUG("Found {} locale suffixes:", suffixes.size());
+        for (const auto &ptr : suffixes)
+            SPDLOG_DEBUG(" {}", *ptr);
+    }
+
+    /// Show cached menu
+    // The cached menu is written to dmenu before desktop files are collected
+    // and parsed. The menu is brought up to date for the next invocation after
+    // the user has made their choice.
+    std::optional<MenuCache> menu_cache;
+    std::optional<std::string> displayed_payload;
+    if (optimistic_menu) {
+        std::string key = fmt::format(
+            "{}\n{:d}\n{:d}\n{}\n{}", appformatter_name, case_insensitive,
+            exclude_generic, (usage_log ? usage_log : ""),
+            AppCache::make_key(locales, desktopenvs, search_path));
+        menu_cache.emplace(get_cache_directory() + "menu-cache",
+                           std::move(key));
+        if (menu_cache->view()) {
+            SPDLOG_INFO("Showing cached menu.");
+            RunPhase::SIGPIPEHandler sig;
+            displayed_payload = *menu_cache->view();
+            dmenu.write_payload(*displayed_payload);
+            dmenu.display();
+        }
+    }
+
     /// Collect desktop files
-    auto desktop_file_list = SetupPhase::collect_files(search_path);
+    ThreadPool pool(ThreadPool::default_worker_count());
+#ifdef USE_KQUEUE
+    auto desktop_file_list = SetupPhase::collect_files(search_path, pool);
+#else
+    // In wait-on mode, directories are watched during the walk which collects
+    // desktop files. Changes made while desktop files are being parsed are
+    // picked up by do_wait_on().
+    std::optional<NotifyInotify> inotify;
+    Desktop_file_list desktop_file_list;
+    if (wait_on)
+        inotify.emplace(search_path, wait_on_close_write, pool,
+                        desktop_file_list);
+    else
+        desktop_file_list = SetupPhase::collect_files(search_path, pool);
+#endif
     SPDLOG_DEBUG("The following desktop files have been found:");
     for (const auto &item : desktop_file_list) {
         SPDLOG_DEBUG(" {}", item.base_path);
         for (const std::string &file : item.files)
             SPDLOG_DEBUG("   {}", file);
     }
-    LocaleSuffixes locales = LocaleSuffixes::from_environment();
-    {
-        auto suffixes = locales.list_suffixes_for_logging_only();
-        SPDLOG_DEBUG("Found {} locale suffixes:", suffixes.size());
-        for (const auto &ptr : suffixes)
-            SPDLOG_DEBUG(" {}", *ptr);
+    /// Load cache
+    std::optional<AppCache> cache;
+    if (use_cache) {
+        std::string cache_path = get_cache_directory() + "app-cache";
+        SPDLOG_INFO("Using desktop file cache '{}'.", cache_path);
+        cache.emplace(std::move(cache_path),
+                      AppCache::make_key(locales, desktopenvs, search_path));
     }
+
     /// Construct AppManager
+    std::unique_ptr<DesktopFileLoader> loader = DesktopFileLoader::create();
     AppManager appm(desktop_file_list, desktopenvs, std::move(locales),
-                    wine_compatibility_mode);
+                    wine_compatibility_mode, (cache ? &*cache : nullptr),
+                    loader.get(), &pool, lazy_exec);
+
+    if (cache)
+        cache->save();
 
 #ifdef DEBUG
     appm.check_inner_state();
@@ -1509,7 +2095,8 @@ int main(int argc, char **argv) {
     }
 
     RunPhase::CommandRetrievalLoop command_retrieval_loop(
-        std::move(dmenu), std::move(mapping), std::move(hist_manager), no_exec);
+        std::move(dmenu), std::move(mapping), std::move(hist_manager), no_exec,
+        std::move(displayed_payload));
 
     using namespace ExecutePhase;
 
@@ -1532,17 +2119,28 @@ int main(int argc, char **argv) {
 #ifdef USE_KQUEUE
             NotifyKqueue notify(search_path);
 #else
-            NotifyInotify notify(search_path);
+            NotifyInotify &notify = *inotify;
+#endif
+#ifdef __GLIBC__
+            // Worker threads have freed a lot of memory used while parsing
+            // desktop files. glibc doesn't return it to the OS by itself.
+            malloc_trim(0);
 #endif
             do_wait_on(notify, wait_on, appm, search_path,
-                       command_retrieval_loop, executor.get());
+                       command_retrieval_loop, executor.get(),
+                       std::chrono::milliseconds(wait_on_delay));
             abort();
         } else {
-            std::optional<RunPhase::CommandRetrievalLoop::CommandInfoVariant>
-                command = command_retrieval_loop.prompt_user_for_choice();
-            if (!command)
+            std::vector<RunPhase::CommandRetrievalLoop::CommandInfoVariant>
+                commands = command_retrieval_loop.prompt_user_for_choice();
+            if (menu_cache)
+                menu_cache->update(
+                    std::string(command_retrieval_loop.get_menu_payload()));
+            if (commands.empty())
                 return 0;
-            executor->execute(*command);
+            if (!RunPhase::load_lazy_values(appm, commands))
+                return EXIT_FAILURE;
+            executor->execute_all(commands);
         }
     } catch (const CMDLineTerm::initialization_error &e) {
         fmt::print(stderr,
@@ -106,7 +106,7 @@ static void rmdir_impl(const std::string &path) {
         enum class file_type { file, directory } ft;
         switch (dirinfo->d_type) {
         case DT_DIR:
-            ft = file_type::file;
+            ft = file_type::directory;
             break;
         case DT_UNKNOWN:
             struct stat info;
@@ -122,7 +122,7 @@ static void rmdir_impl(const std::string &path) {
 
         switch (ft) {
         case file_type::directory:
-            rmdir_recursive(subpath.c_str());
+            rmdir_impl(subpath);
             if (rmdir(subpath.c_str()) == -1)
                 throw std::runtime_error("Error while calling rmdir() on '" +
                                          subpath + "': " + strerror(errno));
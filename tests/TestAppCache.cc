@@ -0,0 +1,169 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <catch2/catch_message.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <errno.h>
+#include <exception>
+#include <fcntl.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "generated/tests_config.hh"
+
+#include "AppCache.hh"
+#include "AppManager.hh"
+#include "Application.hh"
+#include "FSUtils.hh"
+#include "LocaleSuffixes.hh"
+
+static const Desktop_file_list cache_test_files = {
+    {TEST_FILES "a/applications/",
+     {TEST_FILES "a/applications/chromium.desktop",
+      TEST_FILES "a/applications/firefox.desktop",
+      TEST_FILES "a/applications/hidden.desktop"}}
+};
+
+TEST_CASE("Test AppCache round trip", "[AppCache]") {
+    FSUtils::TempFile cache_file("j4dd-appcache-unit-test");
+    LocaleSuffixes ls("en_US");
+    std::string key = AppCache::make_key(ls, {}, {TEST_FILES "a/"});
+
+    {
+        AppCache cache(cache_file.get_name(), key);
+        AppManager apps(cache_test_files, {}, ls, false, &cache);
+        REQUIRE(apps.count() == 3);
+        cache.save();
+    }
+
+    struct stat st;
+    if (stat(TEST_FILES "a/applications/firefox.desktop", &st) == -1)
+        SKIP("Couldn't stat() firefox.desktop: " << strerror(errno));
+
+    {
+        AppCache cache(cache_file.get_name(), key);
+        const AppCache::Entry *entry =
+            cache.lookup(TEST_FILES "a/applications/firefox.desktop", st, 0);
+        REQUIRE(entry != nullptr);
+        REQUIRE(entry->state == AppCache::State::parsed);
+        REQUIRE(entry->app->name == "Firefox");
+        REQUIRE(entry->app->generic_name == "Web browser");
+        REQUIRE(entry->app->exec == "firefox");
+        REQUIRE(entry->app->location ==
+                TEST_FILES "a/applications/firefox.desktop");
+
+        // Rank must match too.
+        REQUIRE(cache.lookup(TEST_FILES "a/applications/firefox.desktop", st,
+                             1) == nullptr);
+
+        struct stat hidden_st;
+        if (stat(TEST_FILES "a/applications/hidden.desktop", &hidden_st) == -1)
+            SKIP("Couldn't stat() hidden.desktop: " << strerror(errno));
+        entry = cache.lookup(TEST_FILES "a/applications/hidden.desktop",
+                             hidden_st, 0);
+        REQUIRE(entry != nullptr);
+        REQUIRE(entry->state == AppCache::State::disabled);
+
+        // AppManager constructed from cache must be identical to the one
+        // constructed directly.
+        AppManager cached_apps(cache_test_files, {}, ls, false, &cache);
+        AppManager apps(cache_test_files, {}, ls);
+        cached_apps.check_inner_state();
+        REQUIRE(cached_apps.count() == apps.count());
+        REQUIRE(cached_apps.view_name_app_mapping().size() ==
+                apps.view_name_app_mapping().size());
+        for (const auto &[name, resolved] : apps.view_name_app_mapping()) {
+            auto iter = cached_apps.view_name_app_mapping().find(name);
+            REQUIRE(iter != cached_apps.view_name_app_mapping().end());
+            REQUIRE(*cached_apps.resolve(iter->second.handle) ==
+                    *apps.resolve(resolved.handle));
+            REQUIRE(iter->second.is_generic == resolved.is_generic);
+        }
+    }
+
+    {
+        // Different locale invalidates the whole cache.
+        AppCache cache(cache_file.get_name(),
+                       AppCache::make_key(LocaleSuffixes("eo"), {},
+                                          {TEST_FILES "a/"}));
+        REQUIRE(cache.lookup(TEST_FILES "a/applications/firefox.desktop", st,
+                             0) == nullptr);
+    }
+    {
+        // So do different desktop environments.
+        AppCache cache(cache_file.get_name(),
+                       AppCache::make_key(ls, {"i3"}, {TEST_FILES "a/"}));
+        REQUIRE(cache.lookup(TEST_FILES "a/applications/firefox.desktop", st,
+                             0) == nullptr);
+    }
+}
+
+TEST_CASE("Test AppCache invalidation of modified desktop files",
+          "[AppCache]") {
+    FSUtils::TempFile cache_file("j4dd-appcache-unit-test");
+    FSUtils::TempFile desktop_file("j4dd-appcache-unit-test-desktop");
+    LocaleSuffixes ls("en_US");
+    std::string key = AppCache::make_key(ls, {}, {"/tmp/"});
+
+    auto copy_to_desktop_file = [&desktop_file](const char *from) {
+        int fd = open(from, O_RDONLY);
+        if (fd == -1)
+            SKIP("Couldn't open desktop file '" << from
+                                                << "': " << strerror(errno));
+        if (ftruncate(desktop_file.get_internal_fd(), 0) == -1) {
+            close(fd);
+            SKIP("Couldn't ftruncate(): " << strerror(errno));
+        }
+        try {
+            desktop_file.copy_from_fd(fd);
+        } catch (const std::exception &e) {
+            close(fd);
+            SKIP("Couldn't copy desktop file: " << e.what());
+        }
+        close(fd);
+    };
+
+    copy_to_desktop_file(TEST_FILES "a/applications/firefox.desktop");
+
+    {
+        AppCache cache(cache_file.get_name(), key);
+        AppManager apps({
+                            {"/tmp/", {desktop_file.get_name()}}
+        },
+                        {}, ls, false, &cache);
+        cache.save();
+    }
+
+    copy_to_desktop_file(TEST_FILES "a/applications/firefox-changed.desktop");
+
+    struct stat st;
+    if (stat(desktop_file.get_name().c_str(), &st) == -1)
+        SKIP("Couldn't stat() desktop file: " << strerror(errno));
+
+    AppCache cache(cache_file.get_name(), key);
+    REQUIRE(cache.lookup(desktop_file.get_name(), st, 0) == nullptr);
+
+    AppManager apps({
+                        {"/tmp/", {desktop_file.get_name()}}
+    },
+                    {}, ls, false, &cache);
+    REQUIRE(apps.view_name_app_mapping().count("Internet browser"));
+    REQUIRE(cache.lookup(desktop_file.get_name(), st, 0) != nullptr);
+}
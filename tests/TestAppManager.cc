@@ -15,6 +15,7 @@
 // along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
 //
 
+#include <catch2/benchmark/catch_benchmark.hpp>
 #include <catch2/catch_message.hpp>
 #include <catch2/catch_test_macros.hpp>
 
@@ -31,6 +32,7 @@
 #include <string_view>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <tuple>
 #include <unistd.h>
 #include <unordered_map>
 #include <utility>
@@ -40,8 +42,10 @@
 
 #include "AppManager.hh"
 #include "Application.hh"
+#include "DesktopFileLoader.hh"
 #include "FSUtils.hh"
 #include "LocaleSuffixes.hh"
+#include "ThreadPool.hh"
 #include "Utilities.hh"
 
 struct check_entry
@@ -49,8 +53,8 @@ struct check_entry
     std::string some_name; // Name or GenericName
     std::string exec;
 
-    check_entry(std::string n, std::string e)
-        : some_name(std::move(n)), exec(std::move(e)) {}
+    check_entry(std::string_view n, std::string_view e)
+        : some_name(n), exec(e) {}
 
     bool operator<(const check_entry &other) const noexcept {
         return this->some_name < other.some_name;
@@ -69,7 +73,8 @@ static bool checkmap(const AppManager &appm, const ctype &cmp) {
     ctype app_name_mapping;
     app_name_mapping.reserve(original_name_mapping.size());
     for (const auto &[name, resolved] : original_name_mapping)
-        app_name_mapping.emplace_back((std::string)name, resolved.app->exec);
+        app_name_mapping.emplace_back((std::string)name,
+                                      appm.resolve(resolved.handle)->exec);
 
     ctype cmp_name_mapping = cmp;
 
@@ -714,7 +719,7 @@ TEST_CASE("Test lookup by ID", "[AppManager]") {
     },
         {}, LocaleSuffixes("en_US"));
 
-    REQUIRE(apps.lookup_by_ID("chromium.desktop").value().get().name ==
+    REQUIRE(apps.resolve(apps.lookup_by_ID("chromium.desktop").value())->name ==
             "Chromium");
 }
 
@@ -1018,3 +1023,447 @@ TEST_CASE("Test removing an unknown desktop file", "[AppManager]") {
     REQUIRE_NOTHROW(apps.remove(TEST_FILES "applications/hidden.desktop",
                                 TEST_FILES "applications/"));
 }
+
+TEST_CASE("Test reusing rows of removed desktop files", "[AppManager]") {
+    AppManager apps(
+        {
+            {TEST_FILES "applications/",
+             {TEST_FILES "applications/eagle.desktop",
+              TEST_FILES "applications/gimp.desktop",
+              TEST_FILES "applications/hidden.desktop"}}
+    },
+        {}, LocaleSuffixes("en_US"));
+
+    REQUIRE(apps.count() == 3);
+
+    for (int i = 0; i < 3; ++i) {
+        auto eagle = apps.lookup_by_ID("eagle.desktop");
+        REQUIRE(eagle);
+        REQUIRE(apps.resolve(*eagle)->name == "Eagle");
+
+        apps.remove(TEST_FILES "applications/eagle.desktop",
+                    TEST_FILES "applications/");
+        apps.remove(TEST_FILES "applications/hidden.desktop",
+                    TEST_FILES "applications/");
+        apps.check_inner_state();
+        REQUIRE(apps.count() == 1);
+        REQUIRE_FALSE(apps.lookup_by_ID("eagle.desktop"));
+
+        apps.add(TEST_FILES "applications/hidden.desktop",
+                 TEST_FILES "applications/", 0);
+        apps.add(TEST_FILES "applications/eagle.desktop",
+                 TEST_FILES "applications/", 0);
+        apps.check_inner_state();
+        REQUIRE(apps.count() == 3);
+
+        // The slot is reused, but the old handle must stay invalid.
+        REQUIRE(apps.resolve(*eagle) == nullptr);
+        REQUIRE(apps.lookup_by_ID("eagle.desktop")->slot == eagle->slot);
+    }
+
+    REQUIRE(apps.lookup_by_ID("eagle.desktop"));
+    REQUIRE_FALSE(apps.lookup_by_ID("hidden.desktop"));
+    ctype check{
+        {"Eagle",                          "eagle -style plastique"},
+        {"GNU Image Manipulation Program", "gimp-2.8 %U"           },
+        {"Image Editor",                   "gimp-2.8 %U"           }
+    };
+    REQUIRE(checkmap(apps, check));
+}
+
+using change_type = AppManager::Name_change::Type;
+using changes_type =
+    std::vector<std::tuple<change_type, std::string, std::string>>;
+
+// Return (type, name, Exec of the current owner) of taken changes sorted by
+// name. Exec is empty for removed names.
+static changes_type take_changes(AppManager &appm) {
+    changes_type result;
+    for (const AppManager::Name_change &change : appm.take_name_changes()) {
+        REQUIRE(change.previous.has_value() !=
+                (change.type == change_type::added));
+        REQUIRE(change.current.has_value() !=
+                (change.type == change_type::removed));
+        result.emplace_back(change.type, change.name,
+                            change.current
+                                ? appm.resolve(change.current->handle)->exec
+                                : "");
+    }
+    std::sort(result.begin(), result.end(),
+              [](const auto &a, const auto &b) {
+                  return std::get<1>(a) < std::get<1>(b);
+              });
+    return result;
+}
+
+TEST_CASE("Test name changes", "[AppManager]") {
+    AppManager apps(
+        {
+            {TEST_FILES "a/applications/",
+             {TEST_FILES "a/applications/chromium.desktop",
+              TEST_FILES "a/applications/firefox.desktop"}},
+            {TEST_FILES "b/applications/",
+             {TEST_FILES "b/applications/chrome.desktop",
+              TEST_FILES "b/applications/safari.desktop"} },
+    },
+        {}, LocaleSuffixes("en_US"));
+
+    // Names added by the constructor aren't reported.
+    REQUIRE(apps.take_name_changes().empty());
+
+    Application_handle firefox = *apps.lookup_by_ID("firefox.desktop");
+    apps.remove(TEST_FILES "a/applications/firefox.desktop",
+                TEST_FILES "a/applications/");
+    {
+        std::vector<AppManager::Name_change> changes =
+            apps.take_name_changes();
+        REQUIRE(changes.size() == 2);
+        for (const AppManager::Name_change &change : changes) {
+            // The previous binding refers to the removed desktop file.
+            REQUIRE(change.previous->handle == firefox);
+            REQUIRE(apps.resolve(change.previous->handle) == nullptr);
+        }
+    }
+    REQUIRE(apps.take_name_changes().empty());
+
+    apps.add(TEST_FILES "a/applications/firefox.desktop",
+             TEST_FILES "a/applications/", 0);
+    {
+        changes_type expected{
+            {change_type::added,   "Firefox",     "firefox"},
+            {change_type::rebound, "Web browser", "firefox"},
+        };
+        REQUIRE(take_changes(apps) == expected);
+    }
+
+    // Changes made between two take_name_changes() are merged.
+    apps.remove(TEST_FILES "a/applications/firefox.desktop",
+                TEST_FILES "a/applications/");
+    apps.add(TEST_FILES "a/applications/firefox.desktop",
+             TEST_FILES "a/applications/", 0);
+    apps.remove(TEST_FILES "b/applications/chrome.desktop",
+                TEST_FILES "b/applications/");
+    {
+        changes_type expected{
+            {change_type::removed, "Chrome",      ""       },
+            {change_type::rebound, "Firefox",     "firefox"},
+            {change_type::rebound, "Web browser", "firefox"},
+        };
+        REQUIRE(take_changes(apps) == expected);
+    }
+
+    // Chrome is added and removed again.
+    apps.add(TEST_FILES "b/applications/chrome.desktop",
+             TEST_FILES "b/applications/", 1);
+    apps.remove(TEST_FILES "b/applications/chrome.desktop",
+                TEST_FILES "b/applications/");
+    REQUIRE(take_changes(apps).empty());
+
+    // Compaction of the string pool doesn't break recorded names.
+    for (int i = 0; i < 200; ++i) {
+        apps.remove(TEST_FILES "b/applications/safari.desktop",
+                    TEST_FILES "b/applications/");
+        apps.add(TEST_FILES "b/applications/safari.desktop",
+                 TEST_FILES "b/applications/", 1);
+    }
+    {
+        changes_type expected{
+            {change_type::rebound, "Safari", "safari"},
+        };
+        REQUIRE(take_changes(apps) == expected);
+    }
+    apps.check_inner_state();
+}
+
+TEST_CASE("Test skipping unchanged desktop files", "[AppManager]") {
+    std::optional<FSUtils::TempFile> tmpfile_container;
+    try {
+        tmpfile_container.emplace("j4dd-appmanager-unit-test");
+    } catch (std::runtime_error &e) {
+        SKIP(e.what());
+    }
+    FSUtils::TempFile &tmpfile = *tmpfile_container;
+
+    auto write_file = [&tmpfile](const char *contents) {
+        int fd = tmpfile.get_internal_fd();
+        if (lseek(fd, 0, SEEK_SET) == (off_t)-1 || ftruncate(fd, 0) == -1)
+            SKIP("Couldn't truncate temporary file: " << strerror(errno));
+        if (writen(fd, contents, strlen(contents)) == -1)
+            SKIP("Couldn't write temporary file: " << strerror(errno));
+    };
+    write_file("[Desktop Entry]\nType=Application\nName=Firefox\n"
+               "Exec=firefox\n");
+
+    SyncDesktopFileLoader loader;
+    AppManager apps(
+        {
+            {"/tmp/", {tmpfile.get_name()}}
+    },
+        {}, LocaleSuffixes("en_US"), false, nullptr, &loader);
+    std::string ID = get_desktop_id(tmpfile.get_name(), "/tmp/");
+    Application_handle handle = *apps.lookup_by_ID(ID);
+
+    // The file hasn't changed since it has been loaded by the constructor.
+    apps.add(tmpfile.get_name(), "/tmp/", 0);
+    REQUIRE(apps.resolve(handle) != nullptr);
+    REQUIRE(apps.take_name_changes().empty());
+
+    // Rewriting the file with identical contents doesn't change anything.
+    write_file("[Desktop Entry]\nType=Application\nName=Firefox\n"
+               "Exec=firefox\n");
+    apps.add(tmpfile.get_name(), "/tmp/", 0);
+    REQUIRE(apps.resolve(handle) != nullptr);
+    REQUIRE(apps.take_name_changes().empty());
+
+    write_file("[Desktop Entry]\nType=Application\nName=Firefox\n"
+               "Exec=firefox --new-window\n");
+    apps.add(tmpfile.get_name(), "/tmp/", 0);
+    REQUIRE(apps.resolve(handle) == nullptr);
+    handle = *apps.lookup_by_ID(ID);
+    REQUIRE(apps.resolve(handle)->exec == "firefox --new-window");
+    REQUIRE(apps.take_name_changes().size() == 1);
+
+    apps.add(tmpfile.get_name(), "/tmp/", 0);
+    REQUIRE(apps.resolve(handle) != nullptr);
+    REQUIRE(apps.take_name_changes().empty());
+
+    // Disabled desktop files are skipped too.
+    write_file("[Desktop Entry]\nType=Application\nName=Firefox\n"
+               "Exec=firefox\nHidden=true\n");
+    apps.add(tmpfile.get_name(), "/tmp/", 0);
+    REQUIRE(apps.view_name_app_mapping().empty());
+    apps.add(tmpfile.get_name(), "/tmp/", 0);
+    REQUIRE(apps.take_name_changes().size() == 1);
+    REQUIRE(apps.count() == 1);
+    apps.check_inner_state();
+}
+
+TEST_CASE("Test adding an identical desktop file with the same ID",
+          "[AppManager]") {
+    char tmpdirname[] = "/tmp/j4dd-appmanager-unit-test-XXXXXX";
+    if (mkdtemp(tmpdirname) == NULL)
+        SKIP("mkdtemp: " << strerror(errno));
+    OnExit rmdir_handler = [&tmpdirname]() {
+        FSUtils::rmdir_recursive(tmpdirname);
+    };
+    std::string base = (std::string)tmpdirname + "/";
+    // Both files have the desktop file ID a-b.desktop.
+    std::string flat = base + "a-b.desktop", nested = base + "a/b.desktop";
+    if (mkdir((base + "a").c_str(), 0777) == -1)
+        SKIP("Couldn't create directory: " << strerror(errno));
+    std::string_view contents = "[Desktop Entry]\nName=App\nExec=app\n";
+    for (const std::string &path : {flat, nested}) {
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+        if (fd == -1 || writen(fd, contents.data(), contents.size()) == -1)
+            SKIP("Couldn't create '" << path << "': " << strerror(errno));
+        close(fd);
+    }
+
+    SyncDesktopFileLoader loader;
+    AppManager appm({{base, {flat}}}, {}, LocaleSuffixes("en_US"), false,
+                    nullptr, &loader);
+    // The contents are the same, but the desktop file is replaced by another
+    // file.
+    appm.add(nested, base, 0);
+    appm.check_inner_state();
+    auto handle = appm.lookup_by_ID("a-b.desktop");
+    REQUIRE(handle);
+    REQUIRE(appm.resolve(*handle)->location == nested);
+}
+
+TEST_CASE("Test parallel parsing", "[AppManager]") {
+    Desktop_file_list files = {
+        // This file doesn't exist. The colliding file in the next rank must
+        // be used instead.
+        {TEST_FILES "c/",
+         {TEST_FILES "c/collision.desktop"}},
+        {TEST_FILES "usr/local/share/applications/",
+         {TEST_FILES "usr/local/share/applications/collision.desktop",
+          TEST_FILES "usr/local/share/applications/couldbehidden.desktop"}},
+        {TEST_FILES "usr/share/applications/",
+         {TEST_FILES "usr/share/applications/collision.desktop",
+          TEST_FILES "usr/share/applications/couldbehidden.desktop"}},
+        {TEST_FILES "a/applications/",
+         {TEST_FILES "a/applications/chromium.desktop",
+          TEST_FILES "a/applications/firefox.desktop",
+          TEST_FILES "a/applications/hidden.desktop"}},
+        {TEST_FILES "applications/", {}},
+    };
+    for (const char *name :
+         {"bad-escape", "caption", "chromium-variant1", "chromium-variant2",
+          "doubleeagle", "eagle", "eagle_shadow", "escape", "escaped",
+          "field_codes", "gimp", "hidden", "htop", "invalid",
+          "missing-entries", "notShowIn", "onlyShowIn", "visible", "web",
+          "web_browser", "whitespaces"}) {
+        files.back().files.push_back((std::string)TEST_FILES "applications/" +
+                                     name + ".desktop");
+    }
+
+    AppManager sequential(files, {"i3"}, LocaleSuffixes("en_US"));
+    ThreadPool pool(3);
+    AppManager parallel(files, {"i3"}, LocaleSuffixes("en_US"), false,
+                        nullptr, nullptr, &pool);
+    parallel.check_inner_state();
+
+    REQUIRE(parallel.count() == sequential.count());
+    ctype expected;
+    for (const auto &[name, resolved] : sequential.view_name_app_mapping())
+        expected.emplace_back((std::string)name,
+                              sequential.resolve(resolved.handle)->exec);
+    REQUIRE(checkmap(parallel, expected));
+
+    auto collision = parallel.lookup_by_ID("collision.desktop");
+    REQUIRE(collision);
+    REQUIRE(parallel.resolve(*collision)->name == "Second");
+}
+
+TEST_CASE("Test lazy Exec parsing", "[AppManager]") {
+    Desktop_file_list files = {
+        {TEST_FILES "a/applications/",
+         {TEST_FILES "a/applications/chromium.desktop",
+          TEST_FILES "a/applications/firefox.desktop"}}
+    };
+
+    AppManager eager(files, {}, LocaleSuffixes("en_US"));
+    AppManager lazy(files, {}, LocaleSuffixes("en_US"), false, nullptr,
+                    nullptr, nullptr, true);
+    lazy.check_inner_state();
+    REQUIRE(lazy.count() == eager.count());
+
+    auto firefox_handle = lazy.lookup_by_ID("firefox.desktop");
+    REQUIRE(firefox_handle);
+    const Application &firefox = *lazy.resolve(*firefox_handle);
+    REQUIRE(firefox.has_lazy_values());
+    REQUIRE(firefox.exec.empty());
+
+    auto loaded = lazy.load_lazy_values(firefox);
+    REQUIRE(loaded.state == Application::ParseState::parsed);
+    REQUIRE_FALSE(loaded.app->has_lazy_values());
+    REQUIRE(*loaded.app ==
+            *eager.resolve(*eager.lookup_by_ID("firefox.desktop")));
+
+    // Applications which have been parsed completely are returned as is.
+    auto reloaded = eager.load_lazy_values(*loaded.app);
+    REQUIRE(reloaded.state == Application::ParseState::parsed);
+    REQUIRE(*reloaded.app == *loaded.app);
+}
+
+TEST_CASE("Test validating Exec of lazily parsed desktop files",
+          "[AppManager]") {
+    char tmpdirname[] = "/tmp/j4dd-appmanager-unit-test-XXXXXX";
+    if (mkdtemp(tmpdirname) == NULL)
+        SKIP("mkdtemp: " << strerror(errno));
+    OnExit rmdir_handler = [&tmpdirname]() {
+        FSUtils::rmdir_recursive(tmpdirname);
+    };
+    std::string base = (std::string)tmpdirname + "/";
+    std::string path = base + "app.desktop";
+    // \\a is unescaped to \a by the desktop file parser. This is an
+    // invalid escape sequence inside of a quoted Exec argument.
+    std::string_view contents =
+        "[Desktop Entry]\nName=App\nExec=\"foo\\\\abar\" arg\n";
+    int fd =
+        open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1 || writen(fd, contents.data(), contents.size()) == -1)
+        SKIP("Couldn't create '" << path << "': " << strerror(errno));
+    close(fd);
+
+    // The desktop file is skipped right away if it isn't parsed lazily.
+    AppManager strict({{base, {path}}}, {}, LocaleSuffixes("en_US"), false);
+    REQUIRE_FALSE(strict.lookup_by_ID("app.desktop"));
+
+    // Lazily parsed desktop files must be rejected once they are loaded.
+    AppManager lazy({{base, {path}}}, {}, LocaleSuffixes("en_US"), false,
+                    nullptr, nullptr, nullptr, true);
+    auto handle = lazy.lookup_by_ID("app.desktop");
+    REQUIRE(handle);
+    auto loaded = lazy.load_lazy_values(*lazy.resolve(*handle));
+    REQUIRE(loaded.state == Application::ParseState::invalid);
+    REQUIRE_FALSE(loaded.app);
+
+    // Wine compatibility mode tolerates malformed Exec keys in both modes.
+    AppManager wine({{base, {path}}}, {}, LocaleSuffixes("en_US"), true,
+                    nullptr, nullptr, nullptr, true);
+    handle = wine.lookup_by_ID("app.desktop");
+    REQUIRE(handle);
+    loaded = wine.load_lazy_values(*wine.resolve(*handle));
+    REQUIRE(loaded.state == Application::ParseState::parsed);
+    REQUIRE(loaded.app->exec == "\"foo\\abar\" arg");
+}
+
+TEST_CASE("Test string pool compaction", "[AppManager]") {
+    char tmpdirname[] = "/tmp/j4dd-appmanager-unit-test-XXXXXX";
+    if (mkdtemp(tmpdirname) == NULL)
+        SKIP("mkdtemp: " << strerror(errno));
+    OnExit rmdir_handler = [&tmpdirname]() {
+        FSUtils::rmdir_recursive(tmpdirname);
+    };
+    std::string base = (std::string)tmpdirname + "/";
+    std::string path = base + "app.desktop";
+
+    AppManager appm({{base, {}}}, {}, LocaleSuffixes("en_US"));
+
+    // Each rewrite of the desktop file wastes memory in the string pool.
+    std::string name;
+    for (int i = 0; i < 200; ++i) {
+        name = "Application " + std::to_string(i) + std::string(200, 'x');
+        std::string contents = "[Desktop Entry]\nName=" + name +
+                               "\nGenericName=Generic\nExec=" + name + "\n";
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                      0600);
+        if (fd == -1 || writen(fd, contents.data(), contents.size()) == -1)
+            SKIP("Couldn't create '" << path << "': " << strerror(errno));
+        close(fd);
+        appm.add(path, base, 0);
+        if (i % 50 == 0)
+            appm.remove(path, base);
+    }
+    appm.check_inner_state();
+
+    REQUIRE(checkmap(appm, {
+                               {name,      name},
+                               {"Generic", name}
+    }));
+    // Without compaction, more than 80 KiB would be used.
+    REQUIRE(appm.view_string_pool().used_bytes() < 20000);
+}
+
+// This benchmark isn't run by default. Run it with
+// j4-dmenu-tests '[benchmark][AppManager]'
+TEST_CASE("Benchmark updating colliding desktop files",
+          "[.][benchmark][AppManager]") {
+    char tmpdirname[] = "/tmp/j4dd-appmanager-benchmark-XXXXXX";
+    if (mkdtemp(tmpdirname) == NULL)
+        SKIP("mkdtemp: " << strerror(errno));
+    OnExit rmdir_handler = [&tmpdirname]() {
+        FSUtils::rmdir_recursive(tmpdirname);
+    };
+    std::string base = (std::string)tmpdirname + "/";
+
+    // All desktop files share a GenericName, so every update of them has to
+    // resolve a name collision. This simulates a large package update.
+    Desktop_file_list files = {
+        {base, {}}
+    };
+    for (int i = 0; i < 5000; ++i) {
+        std::string path = base + "app" + std::to_string(i) + ".desktop";
+        std::string contents = "[Desktop Entry]\nName=Application " +
+                               std::to_string(i) +
+                               "\nGenericName=Web Browser\nExec=app\n";
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+        if (fd == -1 || writen(fd, contents.data(), contents.size()) == -1)
+            SKIP("Couldn't create '" << path << "': " << strerror(errno));
+        close(fd);
+        files.front().files.push_back(std::move(path));
+    }
+
+    AppManager appm(files, {}, LocaleSuffixes("en_US"));
+
+    BENCHMARK("update 500 desktop files") {
+        for (int i = 0; i < 500; ++i) {
+            appm.remove(files.front().files[i], base);
+            appm.add(files.front().files[i], base, 0);
+        }
+        return appm.count();
+    };
+}
@@ -15,14 +15,20 @@
 // along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
 //
 
+#include <catch2/benchmark/catch_benchmark.hpp>
 #include <catch2/catch_test_macros.hpp>
+
+#include <errno.h>
+#include <optional>
 #include <string>
+#include <vector>
 
 #include "generated/tests_config.hh"
 
 #include "Application.hh"
 #include "LineReader.hh"
 #include "LocaleSuffixes.hh"
+#include "StringPool.hh"
 
 TEST_CASE("Test nonexistent file", "[Application]") {
     LocaleSuffixes ls("en_US");
@@ -195,3 +201,190 @@ TEST_CASE("Test opening desktop file with missing required keys",
     REQUIRE_THROWS(Application(
         TEST_FILES "applications/missing-entries.desktop", liner, ls, {}));
 }
+
+TEST_CASE("Test parsing a desktop file from memory", "[Application]") {
+    LocaleSuffixes ls("en_US");
+
+    // Everything after the [Desktop Entry] group must be ignored, even if it
+    // is malformed. The last line doesn't end with a newline.
+    std::string contents = "# Comment\n"
+                           "[Desktop Entry]\n"
+                           "Name = Foo\\sBar\n"
+                           "Exec=foo \\\\n\n"
+                           "OnlyShowIn=i3\\;sway;Gnome\n"
+                           "\n"
+                           "[Desktop Action new]\n"
+                           "this isn't a key=value pair\n"
+                           "Name=Wrong";
+    Application app("memory.desktop", contents, ls, {"Gnome"});
+    REQUIRE(app.name == "Foo Bar");
+    REQUIRE(app.exec == "foo \\n");
+    REQUIRE(app.location == "memory.desktop");
+
+    std::string escaped_semicolon = "[Desktop Entry]\n"
+                                    "Name=Foo\n"
+                                    "Exec=foo\n"
+                                    "OnlyShowIn=i3\\;sway;Gnome";
+    REQUIRE_THROWS_AS(
+        Application("memory.desktop", escaped_semicolon, ls, {"sway"}),
+        disabled_error);
+
+    // Only Name and GenericName can be translated. Keys which only begin with
+    // a known key are unknown keys.
+    std::string translations = "[Desktop Entry]\n"
+                               "Name[de]=Falsch\n"
+                               "Name[en]=English\n"
+                               "NameFoo=Wrong\n"
+                               "GenericName[en_US]=Generic\n"
+                               "Exec=foo\n"
+                               "Exec[en]=bar\n"
+                               "Hidden[en]=true\n"
+                               "Name=Default\n";
+    Application translated("memory.desktop", translations, ls, {});
+    REQUIRE(translated.name == "English");
+    REQUIRE(translated.generic_name == "Generic");
+    REQUIRE(translated.exec == "foo");
+
+    std::string bad_escape = "[Desktop Entry]\nName=Foo\nExec=foo\\";
+    REQUIRE_THROWS_AS(Application("memory.desktop", bad_escape, ls, {}),
+                      escape_error);
+
+    std::string bad_pair = "[Desktop Entry]\nName=Foo\n=foo\n";
+    REQUIRE_THROWS_AS(Application("memory.desktop", bad_pair, ls, {}),
+                      invalid_error);
+}
+
+TEST_CASE("Test ParseResult", "[Application]") {
+    LocaleSuffixes ls("en_US");
+    LineReader liner;
+
+    auto parsed = Application::parse_file(
+        TEST_FILES "applications/eagle.desktop", liner, ls, {});
+    REQUIRE(parsed.state == Application::ParseState::parsed);
+    REQUIRE(parsed.app);
+    REQUIRE(*parsed.app == Application(TEST_FILES "applications/eagle.desktop",
+                                       liner, ls, {}));
+
+    auto disabled = Application::parse_file(
+        TEST_FILES "applications/hidden.desktop", liner, ls, {});
+    REQUIRE(disabled.state == Application::ParseState::disabled);
+    REQUIRE_FALSE(disabled.app);
+    REQUIRE(disabled.reason ==
+            "Refusing to parse Hidden or NoDisplay desktop file.");
+
+    auto invalid = Application::parse_file(
+        TEST_FILES "applications/bad-escape.desktop", liner, ls, {});
+    REQUIRE(invalid.state == Application::ParseState::invalid);
+    REQUIRE_FALSE(invalid.reason.empty());
+    // The error isn't logged by parse_file(), it is left to the caller.
+    REQUIRE_FALSE(invalid.key_error.empty());
+    REQUIRE(disabled.key_error.empty());
+
+    auto unreadable =
+        Application::parse_file("some-file-that-doesnt-exist", liner, ls, {});
+    REQUIRE(unreadable.state == Application::ParseState::unreadable);
+    REQUIRE(unreadable.error == ENOENT);
+
+    std::string contents = "[Desktop Entry]\nName=Foo\nExec=foo\n"
+                           "OnlyShowIn=KDE;\n";
+    auto only_show_in =
+        Application::parse_buffer("memory.desktop", contents, ls, {"i3"});
+    REQUIRE(only_show_in.state == Application::ParseState::disabled);
+}
+
+// This benchmark isn't run by default. Run it with
+// j4-dmenu-tests '[benchmark][Application]'
+TEST_CASE("Benchmark parsing mostly disabled desktop files",
+          "[.][benchmark][Application]") {
+    LocaleSuffixes ls("en_US");
+    stringlist_t desktopenvs = {"i3"};
+
+    // Nine out of ten desktop files are disabled in one of the usual ways.
+    const char *variants[] = {"NoDisplay=true\n", "Hidden=true\n",
+                              "OnlyShowIn=GNOME;\n", "NotShowIn=i3;\n"};
+    std::vector<std::string> corpus;
+    for (int i = 0; i < 1000; ++i) {
+        std::string contents = "[Desktop Entry]\nType=Application\n"
+                               "Name=Application " +
+                               std::to_string(i) + "\nExec=app\n";
+        if (i % 10 != 0)
+            contents += variants[i % 4];
+        corpus.push_back(std::move(contents));
+    }
+
+    // Desktop files are modified during parsing, each iteration needs a fresh
+    // copy. Both benchmarks pay for it.
+    BENCHMARK("exceptions") {
+        int count = 0;
+        for (const std::string &original : corpus) {
+            std::string contents = original;
+            try {
+                Application app("memory.desktop", contents, ls, desktopenvs);
+                ++count;
+            } catch (const disabled_error &) {
+            }
+        }
+        return count;
+    };
+    BENCHMARK("ParseResult") {
+        int count = 0;
+        for (const std::string &original : corpus) {
+            std::string contents = original;
+            auto result = Application::parse_buffer(
+                "memory.desktop", contents, ls, desktopenvs);
+            if (result.state == Application::ParseState::parsed)
+                ++count;
+        }
+        return count;
+    };
+}
+
+TEST_CASE("Test lazy parsing", "[Application]") {
+    LocaleSuffixes ls("en_US");
+    LineReader liner;
+
+    auto lazy = Application::parse_file(TEST_FILES "applications/eagle.desktop",
+                                        liner, ls, {}, true);
+    REQUIRE(lazy.state == Application::ParseState::parsed);
+    REQUIRE(lazy.app->has_lazy_values());
+    REQUIRE(lazy.app->name == "Eagle");
+    REQUIRE(lazy.app->exec.empty());
+    REQUIRE(lazy.app->path.empty());
+
+    auto eager = Application::parse_file(
+        TEST_FILES "applications/eagle.desktop", liner, ls, {});
+    REQUIRE_FALSE(eager.app->has_lazy_values());
+    REQUIRE_FALSE(eager.app->exec.empty());
+
+    // Errors in Exec can't be detected when it isn't parsed.
+    auto bad_escape = Application::parse_file(
+        TEST_FILES "applications/bad-escape.desktop", liner, ls, {}, true);
+    REQUIRE(bad_escape.state == Application::ParseState::parsed);
+}
+
+TEST_CASE("Test copying interned Application", "[Application]") {
+    LocaleSuffixes ls("en_US");
+    LineReader liner;
+    Application original(TEST_FILES "applications/eagle.desktop", liner, ls,
+                         {});
+
+    // Copies share the storage.
+    Application shared = original;
+    REQUIRE(shared.name.data() == original.name.data());
+
+    std::optional<Application> copy;
+    {
+        StringPool pool;
+        Application interned = original;
+        interned.intern(pool);
+        REQUIRE(interned == original);
+        REQUIRE(interned.name.data() != original.name.data());
+        REQUIRE(interned.exec.data()[interned.exec.size()] == '\0');
+
+        // Copies of an interned Application don't depend on the pool.
+        copy = interned;
+        interned.release_strings(pool);
+        REQUIRE(pool.live_bytes() == 0);
+    }
+    REQUIRE(*copy == original);
+}
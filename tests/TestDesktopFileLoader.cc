@@ -0,0 +1,174 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_message.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <memory>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "generated/tests_config.hh"
+
+#include "AppManager.hh"
+#include "DesktopFileLoader.hh"
+#include "FSUtils.hh"
+#include "LocaleSuffixes.hh"
+#include "Utilities.hh"
+
+#ifdef USE_IO_URING
+#include "IoUringLoader.hh"
+#endif
+
+static void check_loader(DesktopFileLoader &loader) {
+    FSUtils::TempFile large_file("j4dd-loader-unit-test");
+    // This is larger than the initial buffer of IoUringDesktopFileLoader.
+    std::string large_contents;
+    for (int i = 0; i < 3000; ++i)
+        large_contents += "Name[xx_" + std::to_string(i) + "]=Something\n";
+    if (writen(large_file.get_internal_fd(), large_contents.data(),
+               large_contents.size()) == -1)
+        SKIP("Couldn't write to temporary file: " << strerror(errno));
+
+    std::vector<const char *> paths = {
+        TEST_FILES "a/applications/firefox.desktop",
+        TEST_FILES "this-doesnt-exist.desktop", large_file.get_name().c_str(),
+        TEST_FILES "a/applications/chromium.desktop"};
+    std::vector<LoadedFile> result = loader.load(paths);
+    REQUIRE(result.size() == paths.size());
+
+    for (int i : {0, 3}) {
+        std::string expected;
+        if (!read_file(paths[i], expected))
+            SKIP("Couldn't read '" << paths[i] << "': " << strerror(errno));
+        REQUIRE(result[i].error == 0);
+        REQUIRE(result[i].contents == expected);
+    }
+    REQUIRE(result[1].error == ENOENT);
+    REQUIRE(result[2].error == 0);
+    REQUIRE(result[2].contents == large_contents);
+
+    REQUIRE(loader.load({}).empty());
+}
+
+TEST_CASE("Test SyncDesktopFileLoader", "[DesktopFileLoader]") {
+    SyncDesktopFileLoader loader;
+    check_loader(loader);
+}
+
+#ifdef USE_IO_URING
+TEST_CASE("Test IoUringDesktopFileLoader", "[DesktopFileLoader]") {
+    std::unique_ptr<IoUringDesktopFileLoader> loader =
+        IoUringDesktopFileLoader::create();
+    if (!loader)
+        SKIP("io_uring isn't available.");
+    check_loader(*loader);
+
+    // Many files must be split to several batches.
+    std::vector<const char *> paths(
+        1000, TEST_FILES "a/applications/firefox.desktop");
+    std::vector<LoadedFile> result = loader->load(paths);
+    for (const LoadedFile &file : result) {
+        REQUIRE(file.error == 0);
+        REQUIRE(file.contents == result.front().contents);
+    }
+}
+#endif
+
+TEST_CASE("Test AppManager with DesktopFileLoader", "[DesktopFileLoader]") {
+    Desktop_file_list files = {
+        {TEST_FILES "a/",
+         {TEST_FILES "a/applications/chromium.desktop",
+          TEST_FILES "a/applications/firefox.desktop",
+          TEST_FILES "a/applications/hidden.desktop"}},
+        {TEST_FILES "b/", {TEST_FILES "b/applications/firefox.desktop"}}
+    };
+    LocaleSuffixes ls("en_US");
+    std::unique_ptr<DesktopFileLoader> loader = DesktopFileLoader::create();
+    AppManager loaded_apps(files, {}, ls, false, nullptr, loader.get());
+    AppManager apps(files, {}, ls);
+    loaded_apps.check_inner_state();
+    REQUIRE(loaded_apps.count() == apps.count());
+    REQUIRE(loaded_apps.view_name_app_mapping().size() ==
+            apps.view_name_app_mapping().size());
+    for (const auto &[name, resolved] : apps.view_name_app_mapping()) {
+        auto iter = loaded_apps.view_name_app_mapping().find(name);
+        REQUIRE(iter != loaded_apps.view_name_app_mapping().end());
+        REQUIRE(*loaded_apps.resolve(iter->second.handle) ==
+                *apps.resolve(resolved.handle));
+    }
+}
+
+// This benchmark isn't run by default. Run it with
+// j4-dmenu-tests '[benchmark][DesktopFileLoader]'
+TEST_CASE("Benchmark DesktopFileLoader",
+          "[.][benchmark][DesktopFileLoader]") {
+    char tmpdirname[] = "/tmp/j4dd-loader-benchmark-XXXXXX";
+    if (mkdtemp(tmpdirname) == NULL)
+        SKIP("mkdtemp: " << strerror(errno));
+    OnExit rmdir_handler = [&tmpdirname]() {
+        FSUtils::rmdir_recursive(tmpdirname);
+    };
+
+    std::string base = (std::string)tmpdirname + "/";
+    std::string contents;
+    if (!read_file(TEST_FILES "a/applications/firefox.desktop", contents))
+        SKIP("Couldn't read firefox.desktop: " << strerror(errno));
+
+    Desktop_file_list files = {
+        {base, {}}
+    };
+    for (int i = 0; i < 2000; ++i) {
+        std::string path = base + "app" + std::to_string(i) + ".desktop";
+        // Use unique names to make AppManager do the same work for all files.
+        std::string unique = contents;
+        unique.insert(unique.find("Name=") + 5, std::to_string(i));
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+        if (fd == -1 || writen(fd, unique.data(), unique.size()) == -1)
+            SKIP("Couldn't create '" << path << "': " << strerror(errno));
+        close(fd);
+        files.front().files.push_back(std::move(path));
+    }
+
+    LocaleSuffixes ls("en_US");
+
+    BENCHMARK("getline (no loader)") {
+        return AppManager(files, {}, ls).count();
+    };
+    SyncDesktopFileLoader sync_loader;
+    BENCHMARK("sync loader") {
+        return AppManager(files, {}, ls, false, nullptr, &sync_loader).count();
+    };
+#ifdef USE_IO_URING
+    std::unique_ptr<IoUringDesktopFileLoader> io_uring_loader =
+        IoUringDesktopFileLoader::create();
+    if (io_uring_loader) {
+        BENCHMARK("io_uring loader") {
+            return AppManager(files, {}, ls, false, nullptr,
+                              io_uring_loader.get())
+                .count();
+        };
+    } else
+        WARN("io_uring isn't available, skipping its benchmark.");
+#endif
+}
@@ -0,0 +1,70 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <catch2/catch_message.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "generated/tests_config.hh"
+
+#include "DesktopFileScanner.hh"
+#include "FileFinder.hh"
+#include "ThreadPool.hh"
+#include "Utilities.hh"
+
+static std::vector<std::string> sequential_scan(const std::string &path) {
+    std::vector<std::string> result;
+    FileFinder finder(path);
+    while (++finder) {
+        if (!finder.isdir() && endswith(finder.path(), ".desktop"))
+            result.push_back(finder.path());
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+TEST_CASE("Test scan_desktop_files", "[DesktopFileScanner]") {
+    stringlist_t search_path = {TEST_FILES "a/", TEST_FILES "b/",
+                                TEST_FILES "c/", TEST_FILES};
+
+    ThreadPool pool(3);
+    Desktop_file_list list = scan_desktop_files(search_path, pool);
+    REQUIRE(list.size() == search_path.size());
+    for (stringlist_t::size_type i = 0; i < search_path.size(); ++i) {
+        INFO("Rank " << i);
+        REQUIRE(list[i].base_path == search_path[i]);
+        REQUIRE(list[i].files == sequential_scan(search_path[i]));
+    }
+
+    // The result mustn't depend on the number of threads.
+    ThreadPool single(0);
+    Desktop_file_list single_list = scan_desktop_files(search_path, single);
+    for (stringlist_t::size_type i = 0; i < search_path.size(); ++i)
+        REQUIRE(single_list[i].files == list[i].files);
+}
+
+TEST_CASE("Test scan_desktop_files with nonexistent directory",
+          "[DesktopFileScanner]") {
+    ThreadPool pool(1);
+    REQUIRE_THROWS_AS(
+        scan_desktop_files({TEST_FILES "this-doesnt-exist/"}, pool),
+        std::runtime_error);
+}
@@ -0,0 +1,139 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <fmt/core.h>
+
+#include <stddef.h>
+#include <string>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "Dmenu.hh"
+#include "PageBuffer.hh"
+
+TEST_CASE("Test Dmenu", "[Dmenu]") {
+    std::vector<std::string> names;
+    for (int i = 0; i < 6000; ++i)
+        names.push_back("Application " + std::to_string(i));
+
+    // More names than fit into a single writev() are written.
+    Dmenu dmenu("tail -n 1", "/bin/sh");
+    dmenu.run();
+    for (const std::string &name : names)
+        dmenu.write(name);
+    dmenu.display();
+    REQUIRE(dmenu.read_choice() == std::vector<std::string>{names.back()});
+
+    // All names are selected. cat writes its output while its input is still
+    // being written, so only a few names are used. They fit into both pipes
+    // whatever their size is.
+    names.resize(100);
+    std::string payload;
+    for (const std::string &name : names)
+        payload += name + '\n';
+    Dmenu multiple("cat", "/bin/sh");
+    multiple.run();
+    multiple.write_payload(payload);
+    multiple.display();
+    REQUIRE(multiple.read_choice() == names);
+
+    // Dmenu returns 1 when the user hasn't selected anything.
+    Dmenu escaped("cat > /dev/null; exit 1", "/bin/sh");
+    escaped.run();
+    escaped.write_payload("Firefox\nChromium\n");
+    escaped.display();
+    REQUIRE(escaped.read_choice().empty());
+}
+
+TEST_CASE("Test Dmenu::splice_payload()", "[Dmenu]") {
+    std::string payload;
+    for (int i = 0; i < 6000; ++i)
+        payload += "Application " + std::to_string(i) + "\n";
+    PageBuffer buffer;
+    buffer.assign(payload);
+
+    // The payload doesn't fit into a pipe of the default size, so dmenu must
+    // read all of it before it writes anything.
+    Dmenu dmenu("sed -n '$='", "/bin/sh");
+    dmenu.run();
+    dmenu.splice_payload(buffer.view());
+    dmenu.display();
+    REQUIRE(dmenu.read_choice() == std::vector<std::string>{"6000"});
+}
+
+// These benchmarks aren't run by default. Run them with
+// j4-dmenu-tests '[benchmark][Dmenu]'
+//
+// fork() copies page tables of the parent, so its latency grows with the
+// resident size of j4-dmenu-desktop (which is large in wait-on mode).
+// Dmenu::run() uses posix_spawn().
+TEST_CASE("Benchmark launching dmenu", "[.][benchmark][Dmenu]") {
+    std::vector<char> ballast;
+    for (size_t mib : {0, 256, 1024}) {
+        // The memory must be touched to become resident.
+        ballast.assign(mib * 1024 * 1024, 1);
+
+        BENCHMARK(fmt::format("Dmenu::run() with {} MiB RSS", mib)) {
+            Dmenu dmenu("exit 1", "/bin/sh");
+            dmenu.run();
+            dmenu.display();
+            return dmenu.read_choice();
+        };
+        BENCHMARK(fmt::format("fork() and exec() with {} MiB RSS", mib)) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                execl("/bin/sh", "/bin/sh", "-c", "exit 1", (char *)nullptr);
+                _exit(127);
+            }
+            int status;
+            waitpid(pid, &status, 0);
+            return status;
+        };
+    }
+}
+
+// Measure delivery of a menu payload of the given number of names to a stub
+// dmenu which discards its input. Run with
+// j4-dmenu-tests '[benchmark][Dmenu]'
+TEST_CASE("Benchmark writing the menu to dmenu", "[.][benchmark][Dmenu]") {
+    for (int count : {1000, 10000, 50000}) {
+        std::string payload;
+        for (int i = 0; i < count; ++i)
+            payload += "Application number " + std::to_string(i) + "\n";
+        PageBuffer buffer;
+        buffer.assign(payload);
+
+        BENCHMARK(fmt::format("write_payload() of {} names", count)) {
+            Dmenu dmenu("cat > /dev/null; exit 1", "/bin/sh");
+            dmenu.run();
+            dmenu.write_payload(buffer.view());
+            dmenu.display();
+            return dmenu.read_choice();
+        };
+        BENCHMARK(fmt::format("splice_payload() of {} names", count)) {
+            Dmenu dmenu("cat > /dev/null; exit 1", "/bin/sh");
+            dmenu.run();
+            dmenu.splice_payload(buffer.view());
+            dmenu.display();
+            return dmenu.read_choice();
+        };
+    }
+}
@@ -33,3 +33,19 @@ TEST_CASE("Test FileFinder", "[FileFinder]") {
     }
     REQUIRE(found);
 }
+
+TEST_CASE("Test FileFinder file types", "[FileFinder]") {
+    FileFinder ff(TEST_FILES);
+    bool found_dir = false, found_file = false;
+    while (++ff) {
+        if (ff.path() == TEST_FILES "a/applications") {
+            REQUIRE(ff.isdir());
+            found_dir = true;
+        } else if (ff.path() == TEST_FILES "a/applications/firefox.desktop") {
+            REQUIRE_FALSE(ff.isdir());
+            found_file = true;
+        }
+    }
+    REQUIRE(found_dir);
+    REQUIRE(found_file);
+}
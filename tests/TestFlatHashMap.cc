@@ -0,0 +1,207 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "FlatHashMap.hh"
+
+TEST_CASE("Test FlatHashMap", "[FlatHashMap]") {
+    FlatHashMap<std::string_view, int> map;
+    REQUIRE(map.empty());
+    REQUIRE(map.find("missing") == map.end());
+    REQUIRE(map.erase("missing") == 0);
+    REQUIRE(map.begin() == map.end());
+
+    REQUIRE(map.try_emplace("Firefox", 1).second);
+    REQUIRE_FALSE(map.try_emplace("Firefox", 2).second);
+    REQUIRE(map.emplace("Chromium", 3).second);
+    REQUIRE(map.size() == 2);
+    REQUIRE(map.find("Firefox")->second == 1);
+
+    // Heterogeneous lookup.
+    std::string key = "Chromium";
+    REQUIRE(map.find(key)->second == 3);
+    REQUIRE(map.count(key.c_str()) == 1);
+
+    map["Eagle"] = 4;
+    ++map["Eagle"];
+    REQUIRE(map.find("Eagle")->second == 5);
+
+    REQUIRE(map.erase("Firefox") == 1);
+    REQUIRE(map.find("Firefox") == map.end());
+    REQUIRE(map.size() == 2);
+
+    std::vector<std::pair<std::string_view, int>> contents(map.begin(),
+                                                           map.end());
+    std::sort(contents.begin(), contents.end());
+    REQUIRE(contents == std::vector<std::pair<std::string_view, int>>{
+                            {"Chromium", 3},
+                            {"Eagle",    5}
+    });
+
+    FlatHashMap<std::string_view, int> copy = map;
+    map.clear();
+    REQUIRE(map.empty());
+    REQUIRE(map.find("Eagle") == map.end());
+    REQUIRE(copy.size() == 2);
+    REQUIRE(copy.find("Eagle")->second == 5);
+
+    FlatHashMap<std::string_view, int> moved = std::move(copy);
+    REQUIRE(moved.size() == 2);
+    REQUIRE(moved.find("Chromium")->second == 3);
+}
+
+TEST_CASE("Test FlatHashMap growth and removal", "[FlatHashMap]") {
+    std::vector<std::string> keys;
+    for (int i = 0; i < 5000; ++i)
+        keys.push_back("app" + std::to_string(i) + ".desktop");
+
+    FlatHashMap<std::string_view, int> map;
+    for (int i = 0; i < (int)keys.size(); ++i)
+        map.try_emplace(keys[i], i);
+    REQUIRE(map.size() == keys.size());
+
+    // Remove every other key while iterating.
+    for (auto iter = map.begin(); iter != map.end();) {
+        if (iter->second % 2)
+            iter = map.erase(iter);
+        else
+            ++iter;
+    }
+    REQUIRE(map.size() == keys.size() / 2);
+    int mismatches = 0;
+    for (int i = 0; i < (int)keys.size(); ++i)
+        mismatches += (map.find(keys[i]) != map.end()) != (i % 2 == 0);
+    REQUIRE(mismatches == 0);
+
+    // Repeated removal and insertion must reuse deleted slots.
+    for (int round = 0; round < 20; ++round) {
+        for (int i = 0; i < (int)keys.size(); i += 2) {
+            mismatches += map.erase(keys[i]) != 1;
+            mismatches += !map.try_emplace(keys[i], i).second;
+        }
+    }
+    REQUIRE(mismatches == 0);
+    REQUIRE(map.size() == keys.size() / 2);
+    for (int i = 0; i < (int)keys.size(); i += 2)
+        mismatches += map.find(keys[i])->second != i;
+    REQUIRE(mismatches == 0);
+
+    FlatHashMap<int, int> ints;
+    ints.reserve(1000);
+    for (int i = 0; i < 1000; ++i)
+        ints[i * 16] = i;
+    for (int i = 0; i < 1000; ++i)
+        mismatches += ints.find(i * 16)->second != i;
+    REQUIRE(mismatches == 0);
+    REQUIRE(ints.count(1) == 0);
+}
+
+TEST_CASE("Test FlatHashSet", "[FlatHashMap]") {
+    FlatHashSet<std::string> set;
+    REQUIRE(set.insert("Firefox").second);
+    REQUIRE_FALSE(set.insert(std::string_view("Firefox")).second);
+    REQUIRE(set.emplace("Chromium").second);
+    REQUIRE(set.size() == 2);
+    REQUIRE(set.count(std::string_view("Chromium")) == 1);
+    REQUIRE(*set.find("Firefox") == "Firefox");
+    REQUIRE(set.erase("Firefox") == 1);
+    REQUIRE(set.count("Firefox") == 0);
+}
+
+// These benchmarks aren't run by default. Run them with
+// j4-dmenu-tests '[benchmark][FlatHashMap]'
+TEST_CASE("Benchmark FlatHashMap", "[.][benchmark][FlatHashMap]") {
+    // Names similar to the ones in name_app_mapping.
+    std::vector<std::string> corpus;
+    for (int i = 0; i < 10000; ++i)
+        corpus.push_back("Application " + std::to_string(i * 7919 % 10000) +
+                         (i % 3 ? " Viewer" : " Editor"));
+    std::vector<std::string_view> keys(corpus.begin(), corpus.end());
+
+    BENCHMARK("std::unordered_map<string_view> insert") {
+        std::unordered_map<std::string_view, int> map;
+        for (int i = 0; i < (int)keys.size(); ++i)
+            map.try_emplace(keys[i], i);
+        return map.size();
+    };
+    BENCHMARK("FlatHashMap<string_view> insert") {
+        FlatHashMap<std::string_view, int> map;
+        for (int i = 0; i < (int)keys.size(); ++i)
+            map.try_emplace(keys[i], i);
+        return map.size();
+    };
+
+    std::unordered_map<std::string_view, int> std_map;
+    FlatHashMap<std::string_view, int> flat_map;
+    for (int i = 0; i < (int)keys.size(); ++i) {
+        std_map.try_emplace(keys[i], i);
+        flat_map.try_emplace(keys[i], i);
+    }
+    // Half of the lookups miss.
+    std::vector<std::string> queries;
+    for (int i = 0; i < 10000; ++i)
+        queries.push_back(i % 2 ? corpus[i] : corpus[i] + "x");
+
+    BENCHMARK("std::unordered_map<string_view> lookup") {
+        long sum = 0;
+        for (const std::string &query : queries) {
+            auto iter = std_map.find(query);
+            if (iter != std_map.end())
+                sum += iter->second;
+        }
+        return sum;
+    };
+    BENCHMARK("FlatHashMap<string_view> lookup") {
+        long sum = 0;
+        for (const std::string &query : queries) {
+            auto iter = flat_map.find(query);
+            if (iter != flat_map.end())
+                sum += iter->second;
+        }
+        return sum;
+    };
+
+    // std::unordered_set<std::string> has to construct a std::string to look
+    // up a string_view.
+    std::unordered_set<std::string> std_set(corpus.begin(), corpus.end());
+    FlatHashSet<std::string> flat_set;
+    for (const std::string &str : corpus)
+        flat_set.insert(str);
+
+    BENCHMARK("std::unordered_set<string> string_view lookup") {
+        size_t found = 0;
+        for (std::string_view key : keys)
+            found += std_set.count(std::string(key));
+        return found;
+    };
+    BENCHMARK("FlatHashSet<string> string_view lookup") {
+        size_t found = 0;
+        for (std::string_view key : keys)
+            found += flat_set.count(key);
+        return found;
+    };
+}
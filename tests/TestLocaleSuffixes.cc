@@ -56,6 +56,24 @@ TEST_CASE("Test short encoding", "[LocaleSuffixes]") {
     REQUIRE_FALSE(ls.match("en_US") == 0);
 }
 
+TEST_CASE("Test rejecting other locales", "[LocaleSuffixes]") {
+    LocaleSuffixes ls("en_US@mod");
+    REQUIRE(ls.match("de") == -1);
+    REQUIRE(ls.match("eo") == -1);
+    REQUIRE(ls.match("en_GB") == -1);
+    REQUIRE(ls.match("") == -1);
+    REQUIRE(ls.match("en_US@averyveryverylongmodifiername") == -1);
+
+    LocaleSuffixes long_locale("en_US@averyveryverylongmodifiername");
+    REQUIRE(long_locale.match("en_US@averyveryverylongmodifiername") == 0);
+    REQUIRE(long_locale.match("en_US@averyveryverylongmodifiernamE") == -1);
+    REQUIRE(long_locale.match("en") == 3);
+
+    LocaleSuffixes empty("");
+    REQUIRE(empty.match("") == 0);
+    REQUIRE(empty.match("en") == -1);
+}
+
 TEST_CASE("Test == operator", "[LocaleSuffixes]") {
     LocaleSuffixes ls("en");
     REQUIRE(ls == ls);
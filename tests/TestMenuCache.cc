@@ -0,0 +1,60 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+
+#include "FSUtils.hh"
+#include "MenuCache.hh"
+
+TEST_CASE("Test MenuCache", "[MenuCache]") {
+    FSUtils::TempFile cache_file("j4dd-menucache-unit-test");
+
+    {
+        // The temporary file is empty, it must be ignored.
+        MenuCache cache(cache_file.get_name(), "key");
+        REQUIRE(!cache.view());
+        cache.update("Firefox\nChromium\n");
+        REQUIRE(cache.view() == "Firefox\nChromium\n");
+    }
+    {
+        MenuCache cache(cache_file.get_name(), "key");
+        REQUIRE(cache.view() == "Firefox\nChromium\n");
+    }
+    {
+        // Payload created with a different key mustn't be used.
+        MenuCache cache(cache_file.get_name(), "other\nkey");
+        REQUIRE(!cache.view());
+        cache.update("");
+    }
+    {
+        MenuCache cache(cache_file.get_name(), "other\nkey");
+        REQUIRE(cache.view() == "");
+    }
+}
+
+TEST_CASE("Test MenuCache::payload_contains", "[MenuCache]") {
+    std::string payload = "Firefox\nFirefox Private\nChromium\n";
+    REQUIRE(MenuCache::payload_contains(payload, "Firefox"));
+    REQUIRE(MenuCache::payload_contains(payload, "Firefox Private"));
+    REQUIRE(MenuCache::payload_contains(payload, "Chromium"));
+    REQUIRE_FALSE(MenuCache::payload_contains(payload, "Private"));
+    REQUIRE_FALSE(MenuCache::payload_contains(payload, "Chrom"));
+    REQUIRE_FALSE(MenuCache::payload_contains(payload, "firefox"));
+    REQUIRE_FALSE(MenuCache::payload_contains("", "Firefox"));
+}
@@ -19,16 +19,23 @@
 #include <fmt/core.h>
 
 #include <errno.h>
+#include <fcntl.h>
 #include <poll.h>
+#include <set>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 // IWYU pragma: no_include <vector>
 // IWYU pragma: no_include <string>
 
 #include "generated/tests_config.hh"
 
+#include "DesktopFileScanner.hh"
+#include "FSUtils.hh"
 #include "NotifyBase.hh"
+#include "ThreadPool.hh"
 #include "Utilities.hh"
 
 #ifdef USE_KQUEUE
@@ -99,3 +106,298 @@ TEST_CASE("Test detection of file creation and deletion of a subdirectory of "
     REQUIRE(found);
     REQUIRE(poll(&towait, 1, 0) == 0);
 }
+
+#ifndef USE_KQUEUE
+#define TEST_SUBDIR TEST_FILES "usr/local/share/newdir"
+
+TEST_CASE("Test detection of desktop files in a newly created subdirectory",
+          "[Notify]") {
+    stringlist_t search_path({TEST_FILES "usr/"});
+    NotifyInotify notify(search_path);
+
+    unlink(TEST_SUBDIR "/nested/app.desktop");
+    rmdir(TEST_SUBDIR "/nested");
+    if (rmdir(TEST_SUBDIR) == -1 && errno != ENOENT)
+        FAIL("Couldn't remove " TEST_SUBDIR ": " << strerror(errno));
+
+    pollfd towait = {notify.getfd(), POLLIN, 0};
+
+    if (mkdir(TEST_SUBDIR, 0777) == -1)
+        FAIL("Couldn't create " TEST_SUBDIR ": " << strerror(errno));
+    if (poll(&towait, 1, 1000) != 1)
+        FAIL("Notify didn't detect the creation of " TEST_SUBDIR);
+    REQUIRE(notify.getchanges().empty());
+
+    // The new subdirectory must be watched.
+    if (mkdir(TEST_SUBDIR "/nested", 0777) == -1)
+        FAIL("Couldn't create " TEST_SUBDIR "/nested: " << strerror(errno));
+    FILE *file = fopen(TEST_SUBDIR "/nested/app.desktop", "w");
+    if (!file)
+        FAIL("Couldn't create app.desktop: " << strerror(errno));
+    fmt::print(file, "DATA");
+    fclose(file);
+
+    if (poll(&towait, 1, 1000) != 1)
+        FAIL("Notify didn't detect the creation of app.desktop");
+    bool found = false;
+    for (const auto &i : notify.getchanges()) {
+        if (i.name == "local/share/newdir/nested/app.desktop") {
+            found = true;
+            REQUIRE(i.rank == 0);
+            REQUIRE(i.status == NotifyBase::modified);
+        }
+    }
+    REQUIRE(found);
+
+    if (unlink(TEST_SUBDIR "/nested/app.desktop") == -1)
+        FAIL("Couldn't remove app.desktop: " << strerror(errno));
+    if (poll(&towait, 1, 1000) != 1)
+        FAIL("Notify didn't detect the deletion of app.desktop");
+    found = false;
+    for (const auto &i : notify.getchanges()) {
+        if (i.name == "local/share/newdir/nested/app.desktop") {
+            found = true;
+            REQUIRE(i.status == NotifyBase::deleted);
+        }
+    }
+    REQUIRE(found);
+
+    rmdir(TEST_SUBDIR "/nested");
+    rmdir(TEST_SUBDIR);
+}
+
+TEST_CASE("Test NotifyInotify sharing the walk with scan_desktop_files()",
+          "[Notify]") {
+    stringlist_t search_path({TEST_FILES "a/", TEST_FILES "usr/"});
+    ThreadPool pool(2);
+    Desktop_file_list files;
+    NotifyInotify notify(search_path, false, pool, files);
+    Desktop_file_list expected = scan_desktop_files(search_path, pool);
+    REQUIRE(files.size() == expected.size());
+    REQUIRE_FALSE(files[0].files.empty());
+    for (size_t i = 0; i < files.size(); ++i)
+        REQUIRE(files[i].files == expected[i].files);
+
+    // Subdirectories found by the walk must be watched.
+    if (unlink(TEST_FILENAME) == -1 && errno != ENOENT)
+        FAIL("Couldn't remove " TEST_FILENAME ": " << strerror(errno));
+    pollfd towait = {notify.getfd(), POLLIN, 0};
+    FILE *file = fopen(TEST_FILENAME, "w");
+    if (!file)
+        FAIL("Couldn't create " TEST_FILENAME ": " << strerror(errno));
+    fmt::print(file, "DATA");
+    fclose(file);
+
+    if (poll(&towait, 1, 1000) != 1)
+        FAIL("Notify didn't detect the creation of " TEST_FILENAME);
+    bool found = false;
+    for (const auto &i : notify.getchanges()) {
+        if (i.name == &TEST_FILENAME[strlen(TEST_FILES "usr/")]) {
+            found = true;
+            REQUIRE(i.rank == 1);
+            REQUIRE(i.status == NotifyBase::modified);
+        }
+    }
+    REQUIRE(found);
+
+    if (unlink(TEST_FILENAME) == -1)
+        FAIL("Couldn't remove " TEST_FILENAME ": " << strerror(errno));
+}
+
+TEST_CASE("Test NotifyInotify reporting only closed files", "[Notify]") {
+    stringlist_t search_path({TEST_FILES "usr/"});
+    NotifyInotify notify(search_path, true);
+
+    if (unlink(TEST_FILENAME) == -1 && errno != ENOENT)
+        FAIL("Couldn't remove " TEST_FILENAME ": " << strerror(errno));
+    pollfd towait = {notify.getfd(), POLLIN, 0};
+
+    int fd = open(TEST_FILENAME, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1)
+        FAIL("Couldn't create " TEST_FILENAME ": " << strerror(errno));
+    OnExit close_handler = [fd]() { close(fd); };
+    if (writen(fd, "DATA", 4) == -1)
+        FAIL("Couldn't write to " TEST_FILENAME ": " << strerror(errno));
+
+    // Creation of the file isn't reported by itself.
+    if (poll(&towait, 1, 1000) != 1)
+        FAIL("Notify didn't detect the creation of " TEST_FILENAME);
+    REQUIRE(notify.getchanges().empty());
+
+    // Writes aren't watched at all.
+    if (writen(fd, "DATA", 4) == -1)
+        FAIL("Couldn't write to " TEST_FILENAME ": " << strerror(errno));
+    REQUIRE(poll(&towait, 1, 0) == 0);
+
+    close_handler.disarm();
+    close(fd);
+    if (poll(&towait, 1, 1000) != 1)
+        FAIL("Notify didn't detect closing of " TEST_FILENAME);
+    auto changes = notify.getchanges();
+    REQUIRE(changes.size() == 1);
+    REQUIRE(changes.front().name ==
+            &TEST_FILENAME[strlen(TEST_FILES "usr/")]);
+    REQUIRE(changes.front().status == NotifyBase::modified);
+
+    if (unlink(TEST_FILENAME) == -1)
+        FAIL("Couldn't remove " TEST_FILENAME ": " << strerror(errno));
+}
+
+static void create_file(const std::string &path) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1 || writen(fd, "DATA", 4) == -1)
+        FAIL("Couldn't create '" << path << "': " << strerror(errno));
+    close(fd);
+}
+
+// Check that the changes of rank are the result of a rescan. All desktop files
+// present in the rank must be reported as modified (exactly once), deleted are
+// the desktop files which must be reported as deleted.
+static void check_rescan(const std::vector<NotifyBase::FileChange> &changes,
+                         const stringlist_t &search_path, int rank,
+                         const std::set<std::string> &deleted) {
+    ThreadPool pool(1);
+    Desktop_file_list files = scan_desktop_files(search_path, pool);
+    std::multiset<std::string> present;
+    for (const std::string &file : files[rank].files)
+        present.insert(file.substr(search_path[rank].size()));
+
+    std::multiset<std::string> reported_modified;
+    std::set<std::string> reported_deleted;
+    for (const auto &change : changes) {
+        if (change.rank != rank)
+            continue;
+        if (change.status == NotifyBase::modified)
+            reported_modified.insert(change.name);
+        else
+            REQUIRE(reported_deleted.insert(change.name).second);
+    }
+    REQUIRE(reported_modified == present);
+    REQUIRE(reported_deleted == deleted);
+}
+
+TEST_CASE("Test NotifyInotify rescanning a rank with too many changes",
+          "[Notify]") {
+    char tmpdirname[] = "/tmp/j4dd-notify-unit-test-XXXXXX";
+    if (mkdtemp(tmpdirname) == NULL)
+        SKIP("mkdtemp: " << strerror(errno));
+    OnExit rmdir_handler = [&tmpdirname]() {
+        FSUtils::rmdir_recursive(tmpdirname);
+    };
+    stringlist_t search_path({(std::string)tmpdirname + "/"});
+    create_file(search_path[0] + "unchanged.desktop");
+    create_file(search_path[0] + "removed.desktop");
+
+    NotifyInotify notify(search_path);
+
+    // Each file generates IN_CREATE and IN_MODIFY.
+    for (int i = 0; i < 300; ++i)
+        create_file(search_path[0] + std::to_string(i) + ".desktop");
+    if (unlink((search_path[0] + "removed.desktop").c_str()) == -1)
+        FAIL("Couldn't remove removed.desktop: " << strerror(errno));
+
+    // Without a rescan, unchanged.desktop wouldn't be reported.
+    auto changes = notify.getchanges();
+    check_rescan(changes, search_path, 0, {"removed.desktop"});
+    REQUIRE(changes.size() == 302);
+
+    // The result of the rescan is remembered.
+    if (unlink((search_path[0] + "0.desktop").c_str()) == -1)
+        FAIL("Couldn't remove 0.desktop: " << strerror(errno));
+    pollfd towait = {notify.getfd(), POLLIN, 0};
+    if (poll(&towait, 1, 1000) != 1)
+        FAIL("Notify didn't detect the deletion of 0.desktop");
+    changes = notify.getchanges();
+    REQUIRE(changes.size() == 1);
+    REQUIRE(changes.front().name == "0.desktop");
+    REQUIRE(changes.front().status == NotifyBase::deleted);
+}
+
+TEST_CASE("Test NotifyInotify rescanning after queue overflow", "[Notify]") {
+    size_t max_queued_events;
+    {
+        FILE *file = fopen("/proc/sys/fs/inotify/max_queued_events", "r");
+        if (!file)
+            SKIP("Couldn't read max_queued_events: " << strerror(errno));
+        int read = fscanf(file, "%zu", &max_queued_events);
+        fclose(file);
+        if (read != 1 || max_queued_events > 1000000)
+            SKIP("Couldn't determine max_queued_events.");
+    }
+
+    char flooded_dirname[] = "/tmp/j4dd-notify-unit-test-XXXXXX";
+    char other_dirname[] = "/tmp/j4dd-notify-unit-test-XXXXXX";
+    if (mkdtemp(flooded_dirname) == NULL || mkdtemp(other_dirname) == NULL)
+        SKIP("mkdtemp: " << strerror(errno));
+    OnExit rmdir_handler = [&flooded_dirname, &other_dirname]() {
+        FSUtils::rmdir_recursive(flooded_dirname);
+        FSUtils::rmdir_recursive(other_dirname);
+    };
+    stringlist_t search_path(
+        {(std::string)flooded_dirname + "/", (std::string)other_dirname + "/"});
+    create_file(search_path[1] + "lost.desktop");
+    create_file(search_path[1] + "kept.desktop");
+
+    NotifyInotify notify(search_path);
+
+    // Identical consecutive events are merged, so writes to two files are
+    // interleaved.
+    std::string a = search_path[0] + "a.desktop",
+                b = search_path[0] + "b.desktop";
+    int afd = open(a.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    int bfd = open(b.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    OnExit close_handler = [afd, bfd]() {
+        close(afd);
+        close(bfd);
+    };
+    if (afd == -1 || bfd == -1)
+        FAIL("Couldn't create desktop files: " << strerror(errno));
+    for (size_t i = 0; i < max_queued_events / 2 + 1; ++i) {
+        if (writen(afd, "A", 1) == -1 || writen(bfd, "B", 1) == -1)
+            FAIL("Couldn't write desktop files: " << strerror(errno));
+    }
+
+    // The queue is full, this event is lost. Only a rescan of the other
+    // (unflooded) rank will notice it.
+    if (unlink((search_path[1] + "lost.desktop").c_str()) == -1)
+        FAIL("Couldn't remove lost.desktop: " << strerror(errno));
+
+    auto changes = notify.getchanges();
+    check_rescan(changes, search_path, 0, {});
+    check_rescan(changes, search_path, 1, {"lost.desktop"});
+}
+
+TEST_CASE("Test NotifyInotify rescanning after a directory is moved out",
+          "[Notify]") {
+    char tmpdirname[] = "/tmp/j4dd-notify-unit-test-XXXXXX";
+    if (mkdtemp(tmpdirname) == NULL)
+        SKIP("mkdtemp: " << strerror(errno));
+    OnExit rmdir_handler = [&tmpdirname]() {
+        FSUtils::rmdir_recursive(tmpdirname);
+    };
+    std::string root = tmpdirname;
+    stringlist_t search_path({root + "/watched/"});
+    if (mkdir(search_path[0].c_str(), 0777) == -1 ||
+        mkdir((search_path[0] + "sub").c_str(), 0777) == -1)
+        FAIL("Couldn't create directories: " << strerror(errno));
+    create_file(search_path[0] + "top.desktop");
+    create_file(search_path[0] + "sub/nested.desktop");
+
+    NotifyInotify notify(search_path);
+
+    // Moving a directory out of the search path doesn't generate events for
+    // its contents.
+    if (rename((search_path[0] + "sub").c_str(), (root + "/moved").c_str()) ==
+        -1)
+        FAIL("Couldn't move directory: " << strerror(errno));
+    pollfd towait = {notify.getfd(), POLLIN, 0};
+    if (poll(&towait, 1, 1000) != 1)
+        FAIL("Notify didn't detect the move of the directory");
+    auto changes = notify.getchanges();
+    check_rescan(changes, search_path, 0, {"sub/nested.desktop"});
+
+    // The moved directory isn't watched anymore.
+    create_file(root + "/moved/new.desktop");
+    REQUIRE(notify.getchanges().empty());
+}
+#endif
@@ -0,0 +1,109 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "NotifyBase.hh"
+#include "NotifyBatch.hh"
+
+using namespace std::chrono_literals;
+
+using changetype = NotifyBase::changetype;
+
+static std::vector<NotifyBase::FileChange>
+make_changes(std::initializer_list<NotifyBase::FileChange> changes) {
+    return changes;
+}
+
+TEST_CASE("Test merging changes in NotifyBatch", "[NotifyBatch]") {
+    NotifyBatch batch(50ms);
+    NotifyBatch::clock::time_point now{};
+    REQUIRE(batch.empty());
+    REQUIRE(batch.get_timeout(now) == -1);
+    REQUIRE_FALSE(batch.is_due(now));
+
+    batch.add(make_changes({
+                  {0, "firefox.desktop",  changetype::modified},
+                  {0, "chromium.desktop", changetype::modified},
+                  {1, "firefox.desktop",  changetype::modified},
+    }),
+              now);
+    batch.add(make_changes({
+                  {0, "firefox.desktop",  changetype::deleted },
+                  {0, "chromium.desktop", changetype::modified},
+    }),
+              now);
+
+    std::vector<NotifyBase::FileChange> changes = batch.take();
+    REQUIRE(batch.empty());
+    REQUIRE(changes.size() == 3);
+    // Changes are ordered by their last occurrence.
+    REQUIRE(changes[0].rank == 1);
+    REQUIRE(changes[0].name == "firefox.desktop");
+    REQUIRE(changes[0].status == changetype::modified);
+    REQUIRE(changes[1].rank == 0);
+    REQUIRE(changes[1].name == "firefox.desktop");
+    REQUIRE(changes[1].status == changetype::deleted);
+    REQUIRE(changes[2].rank == 0);
+    REQUIRE(changes[2].name == "chromium.desktop");
+    REQUIRE(changes[2].status == changetype::modified);
+
+    REQUIRE(batch.take().empty());
+}
+
+TEST_CASE("Test NotifyBatch delay", "[NotifyBatch]") {
+    NotifyBatch batch(50ms);
+    NotifyBatch::clock::time_point start{};
+
+    batch.add(make_changes({
+                  {0, "firefox.desktop", changetype::modified}
+    }),
+              start);
+    REQUIRE(batch.get_timeout(start) == 50);
+    REQUIRE_FALSE(batch.is_due(start + 49ms));
+    REQUIRE(batch.is_due(start + 50ms));
+
+    // Each change postpones the batch, but only up to max_delay_factor times
+    // the delay after the first change.
+    auto now = start;
+    for (int i = 0; i < 20; ++i) {
+        now += 40ms;
+        batch.add(make_changes({
+                      {0, "firefox.desktop", changetype::modified}
+        }),
+                  now);
+    }
+    REQUIRE(batch.is_due(start + NotifyBatch::max_delay_factor * 50ms));
+    REQUIRE(batch.get_timeout(start + 499ms) == 1);
+    REQUIRE(batch.take().size() == 1);
+
+    // Empty changes don't make the batch pending.
+    batch.add({}, now);
+    REQUIRE(batch.empty());
+
+    NotifyBatch immediate(0ms);
+    immediate.add(make_changes({
+                      {0, "firefox.desktop", changetype::modified}
+    }),
+                  start);
+    REQUIRE(immediate.is_due(start));
+    REQUIRE(immediate.get_timeout(start) == 0);
+}
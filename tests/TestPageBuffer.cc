@@ -0,0 +1,49 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <stdint.h>
+#include <string>
+#include <unistd.h>
+
+#include "PageBuffer.hh"
+
+TEST_CASE("Test PageBuffer", "[PageBuffer]") {
+    PageBuffer buffer;
+    REQUIRE(buffer.view().empty());
+
+    std::string large(100000, 'x');
+    buffer.assign(large);
+    REQUIRE(buffer.view() == large);
+    REQUIRE((uintptr_t)buffer.view().data() % sysconf(_SC_PAGESIZE) == 0);
+
+    // Smaller contents reuse the memory.
+    const char *data = buffer.view().data();
+    buffer.assign("Firefox\n");
+    REQUIRE(buffer.view() == "Firefox\n");
+    REQUIRE(buffer.view().data() == data);
+
+    buffer.assign("");
+    REQUIRE(buffer.view().empty());
+
+    // reset() leaves filling the contents to the caller.
+    char *contents = buffer.reset(8);
+    REQUIRE(contents == data);
+    std::string("Chromium").copy(contents, 8);
+    REQUIRE(buffer.view() == "Chromium");
+}
@@ -57,3 +57,12 @@ TEST_CASE("Check SearchPath honors XDG_DATA_DIRS", "[SearchPath]") {
                           "/my/usr/share/applications/",
                       });
 }
+
+TEST_CASE("Check cache directory", "[SearchPath]") {
+    REQUIRE(build_cache_directory("", "/home/testuser") ==
+            "/home/testuser/.cache/j4-dmenu-desktop/");
+    REQUIRE(build_cache_directory("/my/cache", "/home/testuser") ==
+            "/my/cache/j4-dmenu-desktop/");
+    REQUIRE(build_cache_directory("relative/cache", "/home/testuser") ==
+            "/home/testuser/.cache/j4-dmenu-desktop/");
+}
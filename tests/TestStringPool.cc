@@ -0,0 +1,94 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <string_view>
+
+#include "StringPool.hh"
+
+TEST_CASE("Test StringPool interning", "[StringPool]") {
+    StringPool pool;
+    std::string value = "Web Browser";
+
+    std::string_view first = pool.acquire(value);
+    std::string_view second = pool.acquire("Web Browser");
+    REQUIRE(first == "Web Browser");
+    REQUIRE(first.data() != value.data());
+    REQUIRE(first.data() == second.data());
+    REQUIRE(first.data()[first.size()] == '\0');
+    REQUIRE(pool.live_bytes() == value.size() + 1);
+    REQUIRE(pool.used_bytes() == value.size() + 1);
+
+    REQUIRE(pool.acquire("").empty());
+    REQUIRE(pool.live_bytes() == value.size() + 1);
+
+    pool.release(first);
+    REQUIRE(pool.live_bytes() == value.size() + 1);
+    pool.release(second);
+    REQUIRE(pool.live_bytes() == 0);
+
+    // Unreferenced strings are revived.
+    REQUIRE(pool.acquire(value).data() == first.data());
+    REQUIRE(pool.live_bytes() == value.size() + 1);
+    REQUIRE(pool.used_bytes() == value.size() + 1);
+}
+
+TEST_CASE("Test StringPool copies", "[StringPool]") {
+    StringPool pool;
+
+    std::string_view first = pool.copy("firefox %u");
+    std::string_view second = pool.copy("firefox %u");
+    REQUIRE(first == "firefox %u");
+    REQUIRE(second == "firefox %u");
+    REQUIRE(first.data() != second.data());
+    REQUIRE(second.data()[second.size()] == '\0');
+    REQUIRE(pool.live_bytes() == 2 * sizeof "firefox %u");
+
+    pool.release_copy(first);
+    REQUIRE(pool.live_bytes() == sizeof "firefox %u");
+    REQUIRE(pool.used_bytes() == 2 * sizeof "firefox %u");
+}
+
+TEST_CASE("Test StringPool compaction threshold", "[StringPool]") {
+    StringPool pool;
+    std::string_view live = pool.copy(std::string(1000, 'a'));
+
+    std::string value(1000, 'b');
+    for (int i = 0; i < 16; ++i) {
+        value[0] = 'c' + i;
+        pool.release(pool.acquire(value));
+    }
+    // Wasted memory must be larger than a chunk.
+    REQUIRE_FALSE(pool.should_compact());
+    for (int i = 16; i < 20; ++i) {
+        value[0] = 'c' + i;
+        pool.release(pool.acquire(value));
+    }
+    REQUIRE(pool.should_compact());
+
+    REQUIRE(pool.live_bytes() == live.size() + 1);
+}
+
+TEST_CASE("Test StringPool large strings", "[StringPool]") {
+    StringPool pool;
+    std::string large(100000, 'x');
+    std::string_view stored = pool.acquire(large);
+    REQUIRE(stored == large);
+    REQUIRE(pool.acquire("small") == "small");
+}
@@ -0,0 +1,80 @@
+//
+// This file is part of j4-dmenu-desktop.
+//
+// j4-dmenu-desktop is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// j4-dmenu-desktop is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with j4-dmenu-desktop.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <functional>
+#include <stdexcept>
+
+#include "ThreadPool.hh"
+
+TEST_CASE("Test ThreadPool with recursive tasks", "[ThreadPool]") {
+    for (unsigned int workers : {0u, 1u, 3u}) {
+        ThreadPool pool(workers);
+        std::atomic<int> counter = 0;
+        // Build a binary tree of tasks.
+        std::function<void(int)> spawn = [&](int depth) {
+            ++counter;
+            if (depth == 0)
+                return;
+            pool.submit([&spawn, depth]() { spawn(depth - 1); });
+            pool.submit([&spawn, depth]() { spawn(depth - 1); });
+        };
+        pool.submit([&spawn]() { spawn(9); });
+        pool.wait();
+        REQUIRE(counter == 1023);
+
+        // The pool must be reusable.
+        pool.submit([&counter]() { ++counter; });
+        pool.wait();
+        REQUIRE(counter == 1024);
+    }
+}
+
+TEST_CASE("Test ThreadPool waiting for tasks submitting tasks",
+          "[ThreadPool]") {
+    ThreadPool pool(3);
+    for (int round = 0; round < 1000; ++round) {
+        std::atomic<int> children = 0;
+        std::atomic<bool> parent_finished = false;
+        // The children are submitted from a worker. Idle workers (and the
+        // thread calling wait()) steal and finish them while the parent is
+        // still running. wait() mustn't return before the parent finishes.
+        pool.submit([&]() {
+            for (int i = 0; i < 8; ++i)
+                pool.submit([&children]() { ++children; });
+            parent_finished = true;
+        });
+        pool.wait();
+        REQUIRE(parent_finished);
+        REQUIRE(children == 8);
+    }
+}
+
+TEST_CASE("Test ThreadPool exception propagation", "[ThreadPool]") {
+    ThreadPool pool(2);
+    std::atomic<int> counter = 0;
+    pool.submit([]() { throw std::runtime_error("task failed"); });
+    for (int i = 0; i < 10; ++i)
+        pool.submit([&counter]() { ++counter; });
+    REQUIRE_THROWS_AS(pool.wait(), std::runtime_error);
+    REQUIRE(counter == 10);
+
+    // The exception has been consumed.
+    pool.wait();
+}
@@ -17,15 +17,18 @@
 
 #include <catch2/catch_test_macros.hpp>
 
+#include <algorithm>
 #include <errno.h>
 #include <fcntl.h>
 #include <iterator>
+#include <stdint.h>
 #include <string.h>
 #include <string>
+#include <string_view>
 #include <unistd.h>
+#include <vector>
 // Used in setenv(), unsetenv()
 #include <stdlib.h> // IWYU pragma: keep
-// IWYU pragma: no_include <vector>
 
 #include "Utilities.hh"
 
@@ -97,6 +100,26 @@ TEST_CASE("Test get_variable()", "[Utilities]") {
     REQUIRE(get_variable("DOESNTEXIST") == "");
 }
 
+TEST_CASE("Test hash_contents()", "[Utilities]") {
+    std::string contents(1000, 'x');
+    REQUIRE(hash_contents(contents) == hash_contents(std::string(1000, 'x')));
+
+    // Changing any byte or the length changes the hash.
+    std::vector<uint64_t> hashes{hash_contents(contents),
+                                 hash_contents(""),
+                                 hash_contents(std::string_view("x\0", 2)),
+                                 hash_contents("x")};
+    for (size_t i = 0; i < contents.size(); i += 7) {
+        std::string changed = contents;
+        changed[i] = 'y';
+        hashes.push_back(hash_contents(changed));
+        std::string_view suffix = std::string_view(contents).substr(i + 1);
+        hashes.push_back(hash_contents(suffix));
+    }
+    std::sort(hashes.begin(), hashes.end());
+    REQUIRE(std::adjacent_find(hashes.begin(), hashes.end()) == hashes.end());
+}
+
 TEST_CASE("Test writen()", "[Utilities]") {
     int pipefd[2];
     if (pipe(pipefd) == -1)